@@ -0,0 +1,244 @@
+/* Aho-Corasick automaton
+ *
+ * An alternation of plain literals, such as this|that|theother, is
+ * matched with an Aho-Corasick automaton rather than the state
+ * machine, so the cost of a scan doesn't grow with the number of
+ * alternatives.
+ *
+ * Literals are added to a trie, which ac_compile lays out in breadth
+ * first order: the goto transitions of state s are the sorted bytes
+ * label[first[s]..first[s+1]-1], leading to target[...], and are found
+ * by binary search.  The root has a full table.  Each state has a fail
+ * link to the state for the longest proper suffix of its string that
+ * is also in the trie, and out, the length of the longest literal that
+ * is a suffix of its string.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "re.h"
+#include "ac.h"
+#include "mem.h"
+
+enum {
+    AC_ALLOC_SIZE = 256,
+    AC_NONE = -1
+};
+
+/* trie node while literals are being added */
+struct node {
+    int child;          // first child, in a list linked by sibling
+    int sibling;
+    int depth;
+    bool terminal;      // end of a literal
+    unsigned char c;    // byte leading here from the parent
+};
+
+struct ac {
+    struct arena* arena;        // the automaton's memory
+    struct node* nodes;         // trie, freed by ac_compile
+    int nnodes;
+    int max_nodes;
+    int* first;                 // goto transitions, by state
+    unsigned char* label;
+    int* target;
+    int root[256];              // goto transitions of the root
+    int* fail;
+    int* depth;
+    int* out;
+};
+
+/* An empty automaton, allocated from arena but for the trie it is
+ * built from */
+struct ac*
+ac_init(struct arena* arena)
+{
+    struct ac* ac;
+
+    if ((ac = arena_calloc(arena, 1, sizeof(struct ac))) == NULL)
+        return NULL;
+    ac->arena = arena;
+    ac->max_nodes = AC_ALLOC_SIZE;
+    if ((ac->nodes = mem_alloc(ac->max_nodes * sizeof(struct node))) == NULL)
+        return NULL;
+    ac->nodes[0].child = ac->nodes[0].sibling = AC_NONE;
+    ac->nodes[0].depth = 0;
+    ac->nodes[0].terminal = false;
+    ac->nnodes = 1;
+    return ac;
+}
+
+/* Free the trie of an automaton given up on before it was compiled */
+void
+ac_free(struct ac* ac)
+{
+    if (ac == NULL) return;
+    mem_free(ac->nodes);
+    ac->nodes = NULL;
+}
+
+/* Bytes of the automaton, once compiled */
+size_t
+ac_size(struct ac* ac)
+{
+    if (ac == NULL) return 0;
+    return sizeof(struct ac) + (ac->nnodes + 1) * sizeof(int)
+        + ac->nnodes * (1 + 4 * sizeof(int));
+}
+
+/* Add the literal of len bytes at s to the trie */
+bool
+ac_add(struct ac* ac, const char* s, int len)
+{
+    struct node* nodes;
+    int u = 0, v;
+
+    for (int i = 0; i < len; i++) {
+        for (v = ac->nodes[u].child; v != AC_NONE; v = ac->nodes[v].sibling)
+            if (ac->nodes[v].c == (unsigned char) s[i]) break;
+        if (v == AC_NONE) {
+            if (ac->nnodes == ac->max_nodes) {
+                nodes = mem_realloc(ac->nodes, (ac->max_nodes + AC_ALLOC_SIZE)
+                                * sizeof(struct node));
+                if (nodes == NULL) return false;
+                ac->nodes = nodes;
+                ac->max_nodes += AC_ALLOC_SIZE;
+            }
+            v = ac->nnodes++;
+            ac->nodes[v].child = AC_NONE;
+            ac->nodes[v].sibling = ac->nodes[u].child;
+            ac->nodes[v].depth = ac->nodes[u].depth + 1;
+            ac->nodes[v].terminal = false;
+            ac->nodes[v].c = s[i];
+            ac->nodes[u].child = v;
+        }
+        u = v;
+    }
+    ac->nodes[u].terminal = true;
+    return true;
+}
+
+/* goto transition of state s over c, or AC_NONE */
+static int
+go(struct ac* ac, int s, unsigned char c)
+{
+    int lo = ac->first[s], hi = ac->first[s+1] - 1, mid;
+
+    if (s == 0) return ac->root[c];
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (ac->label[mid] == c) return ac->target[mid];
+        if (ac->label[mid] < c) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    return AC_NONE;
+}
+
+static int
+bytecmp(const void* a, const void* b)
+{
+    return (int) ((const struct node*) a)->c - ((const struct node*) b)->c;
+}
+
+/* Lay the trie out in breadth first order and add the fail links */
+bool
+ac_compile(struct ac* ac)
+{
+    int n = ac->nnodes, *order, head = 0, tail = 0, nkids, f;
+    struct node* kids;
+
+    order = mem_alloc(n * sizeof(int));    // trie nodes, breadth first
+    kids = mem_alloc(256 * sizeof(struct node));
+    ac->first = arena_alloc(ac->arena, (n + 1) * sizeof(int));
+    ac->label = arena_alloc(ac->arena, n);
+    ac->target = arena_alloc(ac->arena, n * sizeof(int));
+    ac->fail = arena_alloc(ac->arena, n * sizeof(int));
+    ac->depth = arena_alloc(ac->arena, n * sizeof(int));
+    ac->out = arena_alloc(ac->arena, n * sizeof(int));
+    if (!order || !kids || !ac->first || !ac->label || !ac->target
+        || !ac->fail || !ac->depth || !ac->out) {
+        mem_free(order);
+        mem_free(kids);
+        return false;
+    }
+    order[tail++] = 0;
+    ac->first[0] = 0;
+    // the root goes to itself on bytes no literal starts with
+    for (int c = 0; c < 256; c++) ac->root[c] = 0;
+    while (head < tail) {
+        int u = order[head], s = head++;
+
+        nkids = 0;
+        for (int v = ac->nodes[u].child; v != AC_NONE;
+             v = ac->nodes[v].sibling) {
+            kids[nkids] = ac->nodes[v];
+            kids[nkids++].child = v;    // trie node, for the sort
+        }
+        qsort(kids, nkids, sizeof(struct node), bytecmp);
+        ac->first[s+1] = ac->first[s] + nkids;
+        for (int i = 0; i < nkids; i++) {
+            ac->label[ac->first[s] + i] = kids[i].c;
+            ac->target[ac->first[s] + i] = tail;
+            if (s == 0) ac->root[kids[i].c] = tail;
+            order[tail++] = kids[i].child;
+        }
+        ac->depth[s] = ac->nodes[u].depth;
+    }
+    // fail links, breadth first so that shallower states are done
+    ac->fail[0] = 0;
+    ac->out[0] = 0;
+    for (int s = 0; s < n; s++) {
+        for (int i = ac->first[s]; i < ac->first[s+1]; i++) {
+            int t = ac->target[i];
+            unsigned char c = ac->label[i];
+
+            if (s == 0) f = 0;
+            else {
+                for (f = ac->fail[s]; f != 0 && go(ac, f, c) == AC_NONE;)
+                    f = ac->fail[f];
+                f = go(ac, f, c);
+                if (f == AC_NONE) f = 0;
+            }
+            ac->fail[t] = f;
+            ac->out[t] = ac->nodes[order[t]].terminal?
+                ac->depth[t]:ac->out[f];
+        }
+    }
+    DEBUGV("aho-corasick: %d states\n", n);
+    mem_free(order);
+    mem_free(kids);
+    mem_free(ac->nodes);
+    ac->nodes = NULL;
+    return true;
+}
+
+/* Find the leftmost-longest literal in the len bytes at s, returning
+ * its start and end */
+bool
+ac_scan(struct ac* ac, const char* s, int len, int* start, int* end)
+{
+    int state = 0, t, st;
+    bool found = false;
+
+    for (int i = 0; i < len; i++) {
+        unsigned char c = s[i];
+
+        while (state != 0 && (t = go(ac, state, c)) == AC_NONE)
+            state = ac->fail[state];
+        state = (state == 0)?ac->root[c]:t;
+        if (ac->out[state] != 0) {
+            st = i + 1 - ac->out[state];
+            if (!found || st < *start || (st == *start && i + 1 > *end)) {
+                *start = st;
+                *end = i + 1;
+                found = true;
+            }
+        }
+        // later literals start after the current state's string does
+        if (found && i + 1 - ac->depth[state] > *start) break;
+    }
+    return found;
+}
@@ -0,0 +1,16 @@
+#ifndef AC_H
+#define AC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct arena;
+
+struct ac* ac_init(struct arena*);
+bool ac_add(struct ac*, const char*, int);
+bool ac_compile(struct ac*);
+void ac_free(struct ac*);
+size_t ac_size(struct ac*);
+bool ac_scan(struct ac*, const char*, int, int*, int*);
+
+#endif
@@ -0,0 +1,573 @@
+/* Syntax tree of a pattern
+ *
+ * The parser builds a tree of the pattern, which is rewritten before
+ * the states are emitted from it:
+ *
+ *  - nested sequences and alternates are flattened, and repeated
+ *    alternates dropped,
+ *  - alternates sharing a first or last part have it factored out, so
+ *    this|that|theother is th(is|at|eother),
+ *  - alternates of single characters, dots and classes become one
+ *    class, so a|b|[cd] is [a-d],
+ *  - closures of closures are flattened, so (aa*)* is a* and (a*|b)*
+ *    is (a|b)*.
+ *
+ * Each rewrite leaves fewer states for the matchers to step through.
+ * Matching is leftmost-longest, so the order of alternates doesn't
+ * matter and they may be regrouped freely.  Alternates are compared
+ * only with those of the same hash, found in a table, so that a list
+ * of many thousands of words is rewritten in time near linear in its
+ * size.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include <stdalign.h>
+#include <stddef.h>
+
+#include "re.h"
+#include "sm.h"
+#include "ast.h"
+#include "mem.h"
+
+/* A work area of a rewrite, on the pool's stack of them */
+struct ast_table {
+    struct ast_table* next;
+    alignas(max_align_t) unsigned char data[];
+};
+
+/* A slot of a hash table of nodes */
+struct slot {
+    unsigned long hash;
+    int i;                      // of the node in the list, -1 if empty
+};
+
+static void
+no_memory(struct ast_pool* pool)
+{
+    re_error_code = RE_ERR_MEM;
+    longjmp(*pool->env, RE_ERR_MEM);
+}
+
+static void*
+table_push(struct ast_pool* pool, size_t size)
+{
+    struct ast_table* t;
+
+    if ((t = mem_alloc(sizeof(struct ast_table) + size)) == NULL)
+        no_memory(pool);
+    t->next = pool->tables;
+    pool->tables = t;
+    return t->data;
+}
+
+/* Free the latest work area */
+static void
+table_pop(struct ast_pool* pool)
+{
+    struct ast_table* t = pool->tables;
+
+    pool->tables = t->next;
+    mem_free(t);
+}
+
+struct ast*
+ast_node(struct ast_pool* pool, int type)
+{
+    struct ast* n;
+
+    if ((n = mem_calloc(1, sizeof(struct ast))) == NULL) no_memory(pool);
+    n->type = type;
+    n->all = pool->all;
+    pool->all = n;
+    return n;
+}
+
+void
+ast_free(struct ast_pool* pool)
+{
+    struct ast* n, *next;
+
+    for (n = pool->all; n != NULL; n = next) {
+        next = n->all;
+        if (n->cc != NULL) sm_class_release(n->cc);
+        mem_free(n);
+    }
+    pool->all = NULL;
+    while (pool->tables != NULL) table_pop(pool);
+}
+
+static bool
+equal(struct ast* a, struct ast* b)
+{
+    if (a == NULL || b == NULL) return a == b;
+    if (a->type != b->type || a->c != b->c || a->cc != b->cc) return false;
+    for (a = a->child, b = b->child; a != NULL && b != NULL;
+         a = a->next, b = b->next) {
+        if (!equal(a, b)) return false;
+    }
+    return a == b;
+}
+
+/* A hash of x, the same for nodes that are equal() */
+static unsigned long
+hash(struct ast* x)
+{
+    unsigned long h = x->type * 257 + (unsigned char) x->c;
+
+    h = h * 1000003 ^ (uintptr_t) x->cc;
+    for (x = x->child; x != NULL; x = x->next) h = h * 1000003 + hash(x);
+    return h;
+}
+
+/* An empty hash table for k nodes, of size a power of two, in *mask
+ * one less.  It is the pool's latest work area. */
+static struct slot*
+table(struct ast_pool* pool, int k, size_t extra, int* mask)
+{
+    int size = 2;
+    struct slot* slots;
+
+    while (size < 2 * k) size *= 2;
+    slots = table_push(pool, size * sizeof(struct slot) + extra);
+    for (int i = 0; i < size; i++) slots[i].i = -1;
+    *mask = size - 1;
+    return slots;
+}
+
+/* The slot of the node equal to x among nodes[] in the table, or the
+ * empty one it would go in */
+static struct slot*
+lookup(struct slot* slots, int mask, struct ast** nodes, struct ast* x,
+       unsigned long h)
+{
+    struct slot* sl;
+
+    for (int i = h & mask; ; i = (i + 1) & mask) {
+        sl = slots + i;
+        if (sl->i < 0 || (sl->hash == h && equal(nodes[sl->i], x)))
+            return sl;
+    }
+}
+
+static int
+count(struct ast* n)
+{
+    int k = 0;
+
+    for (n = n->child; n != NULL; n = n->next) k++;
+    return k;
+}
+
+/* The first and last parts of the sequence x, NULL if it is empty */
+static struct ast*
+first(struct ast* x)
+{
+    if (x->type == AST_EMPTY) return NULL;
+    return (x->type == AST_CAT)?x->child:x;
+}
+
+static struct ast*
+last(struct ast* x)
+{
+    if (x->type != AST_CAT) return first(x);
+    for (x = x->child; x->next != NULL; x = x->next)
+        ;
+    return x;
+}
+
+/* x without its first part, sharing x's nodes */
+static struct ast*
+rest(struct ast_pool* pool, struct ast* x)
+{
+    struct ast* r;
+
+    if (x->type != AST_CAT) return ast_node(pool, AST_EMPTY);
+    if (x->child->next->next == NULL) return x->child->next;
+    r = ast_node(pool, AST_CAT);
+    r->child = x->child->next;
+    return r;
+}
+
+/* x without its last part, sharing and cutting x's list */
+static struct ast*
+init(struct ast_pool* pool, struct ast* x)
+{
+    struct ast* r, *y;
+
+    if (x->type != AST_CAT) return ast_node(pool, AST_EMPTY);
+    for (y = x->child; y->next->next != NULL; y = y->next)
+        ;
+    y->next = NULL;
+    if (y == x->child) return y;
+    r = ast_node(pool, AST_CAT);
+    r->child = x->child;
+    return r;
+}
+
+/* n, or its only child, or empty if it has none */
+static struct ast*
+single(struct ast* n)
+{
+    if (n->child == NULL) {
+        n->type = AST_EMPTY;
+        return n;
+    }
+    return (n->child->next == NULL)?n->child:n;
+}
+
+/* Simplify the children of n, splicing in the children of those of
+ * the same type, and leaving out empty parts of a sequence */
+static void
+children(struct ast_pool* pool, struct ast* n)
+{
+    struct ast* x, *next, **tail = &n->child;
+
+    for (x = n->child; x != NULL; x = next) {
+        next = x->next;
+        x = ast_simplify(pool, x);
+        if (x->type == n->type) {
+            for (*tail = x->child; *tail != NULL; tail = &(*tail)->next)
+                ;
+        }
+        else if (x->type != AST_EMPTY || n->type != AST_CAT) {
+            *tail = x;
+            tail = &x->next;
+        }
+    }
+    *tail = NULL;
+}
+
+static struct ast*
+cat(struct ast_pool* pool, struct ast* n)
+{
+    children(pool, n);
+    // x*x* is x*
+    for (struct ast* x = n->child; x != NULL && x->next != NULL; ) {
+        if (x->type == AST_STAR && equal(x, x->next))
+            x->next = x->next->next;
+        else
+            x = x->next;
+    }
+    return single(n);
+}
+
+/* Drop the alternates equal to one before them */
+static void
+dedupe(struct ast_pool* pool, struct ast* n)
+{
+    int k = count(n), mask, i = 0;
+    struct slot* slots, *sl;
+    struct ast** kept, **p, *x;
+    unsigned long h;
+
+    if (k < 2) return;
+    slots = table(pool, k, k * sizeof(struct ast*), &mask);
+    kept = (struct ast**) (slots + mask + 1);
+    for (p = &n->child; (x = *p) != NULL; ) {
+        h = hash(x);
+        if ((sl = lookup(slots, mask, kept, x, h))->i >= 0) {
+            *p = x->next;
+            continue;
+        }
+        sl->hash = h;
+        sl->i = i;
+        kept[i++] = x;
+        p = &x->next;
+    }
+    table_pop(pool);
+}
+
+/* Factor out the first parts alternates share, xy|xz to x(y|z), or if
+ * suffix, the last parts, yx|zx to (y|z)x.  The alternates are first
+ * grouped by part, each group led by its first alternate and in order,
+ * then each group of more than one is replaced, where its leader was,
+ * by the factored sequence. */
+static void
+factor(struct ast_pool* pool, struct ast* n, bool suffix)
+{
+    int k = count(n), mask, i, j, *group, *next, *tail;
+    struct slot* slots, *sl;
+    struct ast** nodes, **parts, **link, **p, *x, *alt, *seq, *part;
+    unsigned long h;
+
+    if (k < 2) return;
+    slots = table(pool, k, 2 * k * sizeof(struct ast*) + 3 * k * sizeof(int),
+                  &mask);
+    nodes = (struct ast**) (slots + mask + 1);
+    parts = nodes + k;
+    group = (int*) (parts + k);
+    next = group + k;
+    tail = next + k;
+    for (i = 0, x = n->child; x != NULL; i++, x = x->next) {
+        nodes[i] = x;
+        next[i] = -1;
+        if ((parts[i] = suffix?last(x):first(x)) == NULL) {
+            group[i] = -1;
+            continue;
+        }
+        h = hash(parts[i]);
+        if ((sl = lookup(slots, mask, parts, parts[i], h))->i >= 0) {
+            group[i] = sl->i;
+            next[tail[sl->i]] = i;
+            tail[sl->i] = i;
+            continue;
+        }
+        sl->hash = h;
+        sl->i = group[i] = tail[i] = i;
+    }
+    link = &n->child;
+    for (i = 0; i < k; i++) {
+        x = nodes[i];
+        if (group[i] >= 0 && group[i] != i) continue;
+        if (group[i] < 0 || next[i] < 0) {
+            *link = x;
+            link = &x->next;
+            continue;
+        }
+        part = parts[i];
+        alt = ast_node(pool, AST_ALT);
+        p = &alt->child;
+        for (j = i; j >= 0; j = next[j]) {
+            *p = suffix?init(pool, nodes[j]):rest(pool, nodes[j]);
+            p = &(*p)->next;
+        }
+        *p = NULL;
+        seq = ast_node(pool, AST_CAT);
+        if (suffix) {
+            seq->child = alt;
+            alt->next = part;
+            part->next = NULL;
+        }
+        else {
+            seq->child = part;
+            part->next = alt;
+        }
+        *link = ast_simplify(pool, seq);
+        link = &(*link)->next;
+    }
+    *link = NULL;
+    table_pop(pool);
+}
+
+static void
+add_bits(unsigned char* bits, struct ast* x)
+{
+    for (int i = 0; i < SM_CLASS_BYTES; i++) {
+        if (x->type == AST_DOT)
+            bits[i] = 0xff;
+        else if (x->type == AST_CC)
+            bits[i] |= x->cc->bits[i];
+    }
+    if (x->type == AST_CHAR) SM_CLASS_SET(bits, (unsigned char) x->c);
+}
+
+/* Merge the alternates that match a single character into a class,
+ * or a dot if it has every character */
+static void
+classes(struct ast_pool* pool, struct ast* n)
+{
+    unsigned char bits[SM_CLASS_BYTES] = {0}, all = 0xff;
+    struct ast** link, **at = NULL, *x, *cc;
+    int merged = 0;
+
+    for (link = &n->child; (x = *link) != NULL; ) {
+        if (x->type != AST_CHAR && x->type != AST_CC && x->type != AST_DOT) {
+            link = &x->next;
+            continue;
+        }
+        add_bits(bits, x);
+        if (at == NULL) {
+            at = link;
+            link = &x->next;
+        }
+        else {
+            *link = x->next;
+            merged++;
+        }
+    }
+    if (merged == 0) return;
+    for (int i = 0; i < SM_CLASS_BYTES; i++) all &= bits[i];
+    cc = ast_node(pool, (all == 0xff)?AST_DOT:AST_CC);
+    if (cc->type == AST_CC && (cc->cc = sm_class_intern(bits)) == NULL)
+        no_memory(pool);
+    cc->next = (*at)->next;
+    *at = cc;
+}
+
+static struct ast*
+alt(struct ast_pool* pool, struct ast* n)
+{
+    children(pool, n);
+    dedupe(pool, n);
+    factor(pool, n, false);
+    factor(pool, n, true);
+    classes(pool, n);
+    return single(n);
+}
+
+/* true if the closure of sequence x is that of the alternates of its
+ * parts with their closures removed: (x*y*)* is (x|y)*, and (xx*)* and
+ * (x*x)* are x* */
+static bool
+closures(struct ast* x)
+{
+    struct ast* y = x->child;
+
+    if (y->next->next == NULL &&
+        ((y->next->type == AST_STAR && equal(y, y->next->child)) ||
+         (y->type == AST_STAR && equal(y->child, y->next))))
+        return true;
+    for (; y != NULL; y = y->next) {
+        if (y->type != AST_STAR) return false;
+    }
+    return true;
+}
+
+static struct ast*
+star(struct ast_pool* pool, struct ast* n)
+{
+    struct ast* x = ast_simplify(pool, n->child), *y, *a, **tail;
+
+    for (;;) {
+        // (x*)* is x*, and ()* is empty
+        if (x->type == AST_STAR || x->type == AST_EMPTY) return x;
+        if (x->type == AST_CAT && closures(x)) {
+            a = ast_node(pool, AST_ALT);
+            tail = &a->child;
+            for (y = x->child; y != NULL; y = y->next) {
+                *tail = (y->type == AST_STAR)?y->child:y;
+                tail = &(*tail)->next;
+            }
+            *tail = NULL;
+            x = ast_simplify(pool, a);
+            continue;
+        }
+        if (x->type != AST_ALT) break;
+        // the closures and empty alternates in (x*|y|)* add nothing
+        for (y = x->child; y != NULL; y = y->next) {
+            if (y->type == AST_STAR || y->type == AST_EMPTY) break;
+        }
+        if (y == NULL) break;
+        tail = &x->child;
+        for (y = x->child; y != NULL; y = y->next) {
+            if (y->type == AST_STAR) {
+                *tail = y->child;
+                tail = &(*tail)->next;
+            }
+            else if (y->type != AST_EMPTY) {
+                *tail = y;
+                tail = &y->next;
+            }
+        }
+        *tail = NULL;
+        x->simplified = false;
+        x = ast_simplify(pool, x);
+    }
+    n->child = x;
+    x->next = NULL;
+    return n;
+}
+
+/* The rewritten tree of n, which may share n's nodes */
+struct ast*
+ast_simplify(struct ast_pool* pool, struct ast* n)
+{
+    if (n->simplified) return n;
+    switch (n->type) {
+        case AST_CAT:
+            n = cat(pool, n);
+            break;
+        case AST_ALT:
+            n = alt(pool, n);
+            break;
+        case AST_STAR:
+            n = star(pool, n);
+            break;
+    }
+    n->simplified = true;
+    return n;
+}
+
+int
+ast_count(struct ast* n)
+{
+    int count = 1;
+
+    for (n = n->child; n != NULL; n = n->next) count += ast_count(n);
+    return count;
+}
+
+static void
+print_char(FILE* fp, int c, const char* special)
+{
+    if (!isprint(c))
+        fprintf(fp, "\\x%02x", c);
+    else if (strchr(special, c) != NULL)
+        fprintf(fp, "\\%c", c);
+    else
+        fputc(c, fp);
+}
+
+/* Print the tree as a pattern */
+void
+ast_print(FILE* fp, struct ast* n)
+{
+    int lo;
+
+    switch (n->type) {
+        case AST_EMPTY:
+            fputs("()", fp);
+            break;
+        case AST_CHAR:
+            print_char(fp, (unsigned char) n->c, "\\()|*.[^$");
+            break;
+        case AST_DOT:
+            fputc('.', fp);
+            break;
+        case AST_BOL:
+            fputc('^', fp);
+            break;
+        case AST_EOL:
+            fputc('$', fp);
+            break;
+        case AST_CC:
+            fputc('[', fp);
+            for (int c = 0; c < 256; c++) {
+                if (!SM_CLASS_HAS(n->cc->bits, c)) continue;
+                for (lo = c; c < 255 && SM_CLASS_HAS(n->cc->bits, c+1); c++)
+                    ;
+                print_char(fp, lo, "\\]^-");
+                if (c > lo) {
+                    if (c > lo + 1) fputc('-', fp);
+                    print_char(fp, c, "\\]^-");
+                }
+            }
+            fputc(']', fp);
+            break;
+        case AST_CAT:
+            for (struct ast* x = n->child; x != NULL; x = x->next) {
+                if (x->type == AST_ALT) fputc('(', fp);
+                ast_print(fp, x);
+                if (x->type == AST_ALT) fputc(')', fp);
+            }
+            break;
+        case AST_ALT:
+            for (struct ast* x = n->child; x != NULL; x = x->next) {
+                ast_print(fp, x);
+                if (x->next != NULL) fputc('|', fp);
+            }
+            break;
+        case AST_STAR:
+            if (n->child->type >= AST_CAT) fputc('(', fp);
+            ast_print(fp, n->child);
+            if (n->child->type >= AST_CAT) fputc(')', fp);
+            fputc('*', fp);
+            break;
+    }
+}
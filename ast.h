@@ -0,0 +1,49 @@
+#ifndef AST_H
+#define AST_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <setjmp.h>
+
+#include "sm.h"
+
+/* node types */
+enum {
+    AST_EMPTY,          // matches the empty string
+    AST_CHAR,
+    AST_DOT,
+    AST_CC,
+    AST_BOL,
+    AST_EOL,
+    AST_CAT,            // the children in turn
+    AST_ALT,            // any one of the children
+    AST_STAR            // the child, zero or more times
+};
+
+struct ast {
+    int type;
+    signed char c;              // AST_CHAR
+    struct sm_class* cc;        // AST_CC, a reference of the node's own
+    struct ast* child;          // first child
+    struct ast* next;           // next sibling
+    struct ast* all;            // next node of the pool
+    bool simplified;
+};
+
+/* The nodes of a pattern's tree, freed together.  If a node can't be
+ * had, re_error_code is set and ast_node jumps to env.  tables are the
+ * work areas of the rewrites in progress, the latest first, freed with
+ * the nodes if a jump leaves them behind. */
+struct ast_pool {
+    struct ast* all;
+    struct ast_table* tables;
+    jmp_buf* env;
+};
+
+struct ast* ast_node(struct ast_pool*, int);
+void ast_free(struct ast_pool*);
+struct ast* ast_simplify(struct ast_pool*, struct ast*);
+int ast_count(struct ast*);
+void ast_print(FILE*, struct ast*);
+
+#endif
@@ -0,0 +1,117 @@
+/* Substring search for patterns that are plain strings
+ *
+ * A pattern with no special characters matches where the string
+ * first occurs, so no state machine is needed.  Candidates are found
+ * 16 at a time with SSE2, comparing the first and last bytes of the
+ * string at 16 positions at once, and checked with memcmp.
+ * Elsewhere, and for the last few positions, Boyer-Moore-Horspool is
+ * used.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "re.h"
+#include "bmh.h"
+#include "mem.h"
+
+struct bmh {
+    char* s;
+    int len;
+    int skip[256];      // shift by the last byte of the window
+};
+
+/* A search for the len bytes at s, allocated from arena */
+struct bmh*
+bmh_init(struct arena* arena, const char* s, int len)
+{
+    struct bmh* b;
+
+    if ((b = arena_alloc(arena, sizeof(struct bmh))) == NULL ||
+        (b->s = arena_copy(arena, s, len)) == NULL)
+        return NULL;
+    b->len = len;
+    for (int c = 0; c < 256; c++) b->skip[c] = len;
+    for (int i = 0; i < len - 1; i++)
+        b->skip[(unsigned char) s[i]] = len - 1 - i;
+    DEBUGV("plain string: %.*s\n", len, s);
+    return b;
+}
+
+size_t
+bmh_size(struct bmh* b)
+{
+    return (b == NULL)?0:sizeof(struct bmh) + b->len;
+}
+
+static const char*
+horspool(struct bmh* b, const char* s, int len, int i)
+{
+    int n = b->len;
+    unsigned char last = b->s[n-1];
+
+    while (i <= len - n) {
+        unsigned char c = s[i+n-1];
+        if (c == last && memcmp(s + i, b->s, n - 1) == 0) return s + i;
+        i += b->skip[c];
+    }
+    return NULL;
+}
+
+#ifdef __SSE2__
+/* Positions of the 16 from s where the string's first byte and, n-1
+ * bytes on, its last byte are, as a bit mask */
+static inline unsigned
+candidates(const char* s, int n, __m128i first, __m128i last)
+{
+    __m128i bf = _mm_loadu_si128((const __m128i*) s);
+    __m128i bl = _mm_loadu_si128((const __m128i*) (s + n - 1));
+
+    return _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bf, first),
+                                           _mm_cmpeq_epi8(bl, last)));
+}
+#endif
+
+/* The first occurrence of the string in the len bytes at s, or NULL */
+static const char*
+find(struct bmh* b, const char* s, int len)
+{
+    int i = 0, n = b->len;
+
+    if (n == 1) return memchr(s, *b->s, len);
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(b->s[0]), last = _mm_set1_epi8(b->s[n-1]);
+    unsigned mask;
+
+    // 32 positions a loop, for the memory system to keep up
+    for (; i + n - 1 + 32 <= len; i += 32) {
+        mask = candidates(s + i, n, first, last) |
+            candidates(s + i + 16, n, first, last) << 16;
+        while (mask != 0) {
+            int k = i + __builtin_ctz(mask);
+            if (memcmp(s + k + 1, b->s + 1, n - 2) == 0) return s + k;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    return horspool(b, s, len, i);
+}
+
+/* Find the first occurrence of the string in the len bytes at s,
+ * returning its start and end */
+bool
+bmh_find(struct bmh* b, const char* s, int len, int* start, int* end)
+{
+    const char* p = find(b, s, len);
+
+    if (p == NULL) return false;
+    *start = p - s;
+    *end = *start + b->len;
+    return true;
+}
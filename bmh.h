@@ -0,0 +1,13 @@
+#ifndef BMH_H
+#define BMH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct arena;
+
+struct bmh* bmh_init(struct arena*, const char*, int);
+size_t bmh_size(struct bmh*);
+bool bmh_find(struct bmh*, const char*, int, int*, int*);
+
+#endif
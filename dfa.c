@@ -0,0 +1,723 @@
+/* Lazy DFA
+ *
+ * DFA states are sets of state machine states, built by subset
+ * construction only when a scan first reaches them.  Each DFA state
+ * caches its transitions, one per byte class, so once the states in
+ * use have been built a scan costs one table lookup per byte.
+ * The states are built in an arena of the cache's, released when the
+ * cache is full and flushed, so the memory is reused and a scan
+ * allocates only until the cache has taken enough.
+ *
+ * A DFA scans either forward or, over the reversed state machine, from
+ * the end of the string back to its start.  re_match uses an
+ * unanchored reverse scan to find where the leftmost match starts, and
+ * an anchored forward scan from there to find where it ends.
+ *
+ * dfa_compile builds every state ahead of time instead, then
+ * minimises the DFA to a flat transition table, for a scan that does
+ * no allocation and costs the same for every byte.  dfa_jit turns the
+ * table into native code (jit.c).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "re.h"
+#include "sm.h"
+#include "dfa.h"
+#include "jit.h"
+#include "mem.h"
+
+enum {
+    DFA_MAX_STATES = 1024,      // cached states before a flush
+    DFA_MAX_FLUSH = 4,          // flushes in one scan before giving up
+    DFA_MAX_FULL = 8192,        // states in a compiled DFA
+    DFA_BLOCK = 8192,           // of the arena states are built in
+    DFA_UNKNOWN = -1,           // transition not yet built
+    AT_START = 1,               // assertions, relative to the scan
+    AT_END = 2                  // direction
+};
+
+/* transition of the state machine, in the direction of the scan */
+struct edge {
+    int to;
+    int via;    // assertion for epsilon edges, matching state for steps
+};
+
+struct dstate {
+    int* set;           // kernel: sorted states with steps, pending
+    int n;              // assertions or the accept state
+    bool at_start;      // initial state at the start of the string
+    bool accept;
+    bool accept_end;    // accepts at the end of the string
+    int next[];         // transitions, by byte class
+};
+
+struct dfa {
+    struct sm_fsm* fsm;
+    struct sm_entry* machine;
+    int m;                      // number of machine states
+    int flags;
+    int seed;                   // state a match starts from
+    int accept;                 // state a match ends at
+    int* eps_idx;               // epsilon edges of state i are
+    struct edge* eps;           //   eps[eps_idx[i]..eps_idx[i+1]-1]
+    int* step_idx;              // and edges over a character are
+    struct edge* step;          //   step[step_idx[i]..step_idx[i+1]-1]
+    unsigned char classes[256]; // byte class of each byte
+    unsigned char rep[256];     // a byte from each class
+    int nclasses;
+    int* table;                 // compiled DFA, by state and byte class
+    unsigned char* accepts;     // compiled acceptance, by state
+    int tinit[2];               // compiled initial and dead states
+    int tdead;
+    int ntable;                 // compiled states
+    jit_scan jit;               // native code for the compiled DFA
+    void* jit_mem;
+    size_t jit_size;
+};
+
+/* The states built so far, kept apart from the DFA so that one DFA can
+ * be scanned from several threads, each with its own cache */
+struct dfa_cache {
+    struct arena* arena;        // the states, made with the first
+    struct arena_mark empty;    // and released by a flush
+    struct dstate** states;
+    int nstates;
+    int max_states;
+    int* hash;                  // open addressed, size 2*max_states
+    int init[2];                // initial states, by at_start
+    int nflush;
+    int gen;                    // work areas for subset construction
+    int* mark;
+    int* stack;
+    int* buf;
+    int* work;
+};
+
+static bool
+consumes(struct sm_entry* st)
+{
+    return st->event != RE_NODE && st->event != RE_BOL &&
+        st->event != RE_EOL;
+}
+
+static int
+intcmp(const void* a, const void* b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+/* true if an earlier state already refined the byte classes by the
+ * machine's class cls */
+static bool
+class_seen(struct dfa* d, int u, int cls)
+{
+    for (int v = 1; v < u; v++) {
+        if (d->machine[v].event == RE_CC && d->machine[v].next2 == cls)
+            return true;
+    }
+    return false;
+}
+
+/* Partition the bytes into classes which no state distinguishes */
+static void
+byte_classes(struct dfa* d)
+{
+    int map[512], n;
+    unsigned char newc[256];
+    bool seen[256] = {false};
+    struct sm_entry* st;
+
+    memset(d->classes, 0, sizeof(d->classes));
+    d->nclasses = 1;
+    for (int u = 1; u < d->m; u++) {
+        st = d->machine+u;
+        if (!consumes(st) || st->event == RE_DOT) continue;
+        if (st->event == RE_CC && class_seen(d, u, st->next2)) continue;
+        if (st->event > '\0') {
+            if (seen[(unsigned char) st->event]) continue;
+            seen[(unsigned char) st->event] = true;
+        }
+        for (int i = 0; i < 2 * d->nclasses; i++) map[i] = -1;
+        n = 0;
+        for (int c = 0; c < 256; c++) {
+            int k = 2 * d->classes[c] + sm_event_match(d->fsm, st, c);
+            if (map[k] < 0) map[k] = n++;
+            newc[c] = map[k];
+        }
+        memcpy(d->classes, newc, sizeof(newc));
+        d->nclasses = n;
+    }
+    for (int c = 255; c >= 0; c--) d->rep[d->classes[c]] = c;
+}
+
+static void
+add_edge(int* idx, struct edge* edges, int from, int to, int via)
+{
+    edges[idx[from]].to = to;
+    edges[idx[from]++].via = via;
+}
+
+/* Build the edge lists for the direction of the scan.  State 0 is
+ * only ever the accept state, so its own transitions are ignored. */
+static void
+build_edges(struct dfa* d, bool count)
+{
+    bool rev = d->flags & DFA_REVERSE;
+    int bol = rev?AT_END:AT_START, eol = rev?AT_START:AT_END;
+    struct sm_entry* st;
+
+    for (int u = 1; u < d->m; u++) {
+        st = d->machine+u;
+        if (count) {
+            // count edges leaving each state
+            if (consumes(st))
+                d->step_idx[(rev?st->next1:u)+1]++;
+            else {
+                d->eps_idx[(rev?st->next1:u)+1]++;
+                if (st->event == RE_NODE && st->next2 != st->next1)
+                    d->eps_idx[(rev?st->next2:u)+1]++;
+            }
+        }
+        else if (consumes(st)) {
+            if (rev)
+                add_edge(d->step_idx, d->step, st->next1, u, u);
+            else
+                add_edge(d->step_idx, d->step, u, st->next1, u);
+        }
+        else {
+            int via = (st->event == RE_BOL)?bol:
+                (st->event == RE_EOL)?eol:0;
+            if (rev)
+                add_edge(d->eps_idx, d->eps, st->next1, u, via);
+            else
+                add_edge(d->eps_idx, d->eps, u, st->next1, via);
+            if (st->event == RE_NODE && st->next2 != st->next1) {
+                if (rev)
+                    add_edge(d->eps_idx, d->eps, st->next2, u, 0);
+                else
+                    add_edge(d->eps_idx, d->eps, u, st->next2, 0);
+            }
+        }
+    }
+}
+
+/* A DFA over fsm, allocated from its arena */
+struct dfa*
+dfa_init(struct sm_fsm* fsm, int flags)
+{
+    struct dfa* d;
+    int m = fsm->max_state + 1;
+
+    if ((d = arena_calloc(fsm->arena, 1, sizeof(struct dfa))) == NULL)
+        return NULL;
+    d->fsm = fsm;
+    d->machine = fsm->fsm;
+    d->m = m;
+    d->flags = flags;
+    d->seed = (flags & DFA_REVERSE)?0:d->machine->next1;
+    d->accept = (flags & DFA_REVERSE)?d->machine->next1:0;
+    d->eps_idx = arena_calloc(fsm->arena, m + 1, sizeof(int));
+    d->step_idx = arena_calloc(fsm->arena, m + 1, sizeof(int));
+    if (!d->eps_idx || !d->step_idx) return NULL;
+    // edge lists, in compressed rows indexed by state
+    build_edges(d, true);
+    for (int i = 0; i < m; i++) {
+        d->eps_idx[i+1] += d->eps_idx[i];
+        d->step_idx[i+1] += d->step_idx[i];
+    }
+    d->eps = arena_alloc(fsm->arena, d->eps_idx[m] * sizeof(struct edge));
+    d->step = arena_alloc(fsm->arena, d->step_idx[m] * sizeof(struct edge));
+    if (!d->eps || !d->step) return NULL;
+    build_edges(d, false);
+    for (int i = m; i > 0; i--) {
+        d->eps_idx[i] = d->eps_idx[i-1];
+        d->step_idx[i] = d->step_idx[i-1];
+    }
+    d->eps_idx[0] = d->step_idx[0] = 0;
+    byte_classes(d);
+    DEBUGV("dfa: %s, %d byte classes\n",
+           (flags & DFA_REVERSE)?"reverse":"forward", d->nclasses);
+    return d;
+}
+
+/* Bytes of the DFA, its edge lists and any compiled table, but not
+ * the states a cache builds as it scans */
+size_t
+dfa_size(struct dfa* d)
+{
+    if (d == NULL) return 0;
+    return sizeof(struct dfa) + 2 * (d->m + 1) * sizeof(int)
+        + (d->eps_idx[d->m] + d->step_idx[d->m]) * sizeof(struct edge)
+        + d->ntable * (d->nclasses * sizeof(int) + 1);
+}
+
+/* and of its native code, kept apart from the arena */
+size_t
+dfa_code_size(struct dfa* d)
+{
+    return (d == NULL)?0:d->jit_size;
+}
+
+/* Free the DFA's native code, the rest going with the arena */
+void
+dfa_free(struct dfa* d)
+{
+    if (d != NULL) jit_free(d->jit_mem, d->jit_size);
+}
+
+static struct dfa_cache*
+cache_init(struct dfa* d, int max_states)
+{
+    struct dfa_cache* dc;
+
+    if ((dc = mem_calloc(1, sizeof(struct dfa_cache))) == NULL) return NULL;
+    dc->max_states = max_states;
+    dc->states = mem_alloc(max_states * sizeof(struct dstate*));
+    dc->hash = mem_alloc(2 * max_states * sizeof(int));
+    dc->mark = mem_calloc(d->m, sizeof(int));
+    dc->stack = mem_alloc((3 * d->m + 1) * sizeof(int));
+    dc->buf = mem_alloc((d->m + 1) * sizeof(int));
+    dc->work = mem_alloc(d->m * sizeof(int));
+    if (!dc->states || !dc->hash || !dc->mark || !dc->stack || !dc->buf ||
+        !dc->work) {
+        dfa_cache_free(dc);
+        return NULL;
+    }
+    memset(dc->hash, -1, 2 * max_states * sizeof(int));
+    dc->init[0] = dc->init[1] = DFA_UNKNOWN;
+    return dc;
+}
+
+/* A cache for scanning with d, or NULL if none is needed */
+struct dfa_cache*
+dfa_cache_init(struct dfa* d)
+{
+    return d->table?NULL:cache_init(d, DFA_MAX_STATES);
+}
+
+void
+dfa_cache_free(struct dfa_cache* dc)
+{
+    if (dc == NULL) return;
+    arena_free(dc->arena);
+    mem_free(dc->states);
+    mem_free(dc->hash);
+    mem_free(dc->mark);
+    mem_free(dc->stack);
+    mem_free(dc->buf);
+    mem_free(dc->work);
+    mem_free(dc);
+}
+
+/* Follow the epsilon edges from the n states in set, passing the
+ * assertions in allow.  The kernel of the closure is left sorted in
+ * dc->work; returns its size. */
+static int
+closure(struct dfa* d, struct dfa_cache* dc, int* set, int n, int allow)
+{
+    int sp = 0, k = 0, x;
+    bool keep;
+
+    dc->gen++;
+    for (int i = 0; i < n; i++) dc->stack[sp++] = set[i];
+    while (sp > 0) {
+        x = dc->stack[--sp];
+        if (dc->mark[x] == dc->gen) continue;
+        dc->mark[x] = dc->gen;
+        keep = x == d->accept || d->step_idx[x] < d->step_idx[x+1];
+        for (int i = d->eps_idx[x]; i < d->eps_idx[x+1]; i++) {
+            if (d->eps[i].via & ~allow)
+                keep |= d->eps[i].via == AT_END;
+            else
+                dc->stack[sp++] = d->eps[i].to;
+        }
+        if (keep) dc->work[k++] = x;
+    }
+    qsort(dc->work, k, sizeof(int), intcmp);
+    return k;
+}
+
+static void
+flush(struct dfa_cache* dc)
+{
+    DEBUGV("dfa: flushing %d states\n", dc->nstates);
+    arena_release(dc->arena, dc->empty);
+    dc->nstates = 0;
+    memset(dc->hash, -1, 2 * dc->max_states * sizeof(int));
+    dc->init[0] = dc->init[1] = DFA_UNKNOWN;
+    dc->nflush++;
+}
+
+/* Find the DFA state with kernel set, adding it if new */
+static int
+lookup(struct dfa* d, struct dfa_cache* dc, int* set, int n, bool at_start)
+{
+    unsigned h = at_start, size = 2 * dc->max_states;
+    int i;
+    struct dstate* s;
+
+    for (i = 0; i < n; i++) h = h * 31 + set[i];
+    for (i = h % size; dc->hash[i] >= 0; i = (i+1) % size) {
+        s = dc->states[dc->hash[i]];
+        if (s->n == n && s->at_start == at_start &&
+            memcmp(s->set, set, n * sizeof(int)) == 0)
+            return dc->hash[i];
+    }
+    if (dc->nstates == dc->max_states) {
+        if (dc->nflush == DFA_MAX_FLUSH) return DFA_FAILED;
+        flush(dc);
+        i = h % size;
+    }
+    if (dc->arena == NULL) {
+        if ((dc->arena = arena_init(DFA_BLOCK)) == NULL) return DFA_FAILED;
+        dc->empty = arena_mark(dc->arena);
+    }
+    s = arena_alloc(dc->arena,
+                    sizeof(struct dstate) + (d->nclasses + n) * sizeof(int));
+    if (s == NULL) return DFA_FAILED;
+    s->set = s->next + d->nclasses;
+    memcpy(s->set, set, n * sizeof(int));
+    s->n = n;
+    s->at_start = at_start;
+    for (int c = 0; c < d->nclasses; c++) s->next[c] = DFA_UNKNOWN;
+    s->accept = bsearch(&d->accept, set, n, sizeof(int), intcmp) != NULL;
+    closure(d, dc, s->set, n, AT_END | (at_start?AT_START:0));
+    s->accept_end = dc->mark[d->accept] == dc->gen;
+    dc->states[dc->nstates] = s;
+    dc->hash[i] = dc->nstates;
+    DEBUGV("dfa: state %d, %d kernel states%s\n", dc->nstates, n,
+           s->accept?", accepts":"");
+    return dc->nstates++;
+}
+
+static int
+initial(struct dfa* d, struct dfa_cache* dc, bool at_start)
+{
+    int k;
+
+    if (dc->init[at_start] == DFA_UNKNOWN) {
+        k = closure(d, dc, &d->seed, 1, at_start?AT_START:0);
+        dc->init[at_start] = lookup(d, dc, dc->work, k, at_start);
+    }
+    return dc->init[at_start];
+}
+
+/* Build the transition from state over byte class c */
+static int
+transition(struct dfa* d, struct dfa_cache* dc, int from, int c)
+{
+    struct dstate* s = dc->states[from];
+    int n = 0, k, to, nflush = dc->nflush, x;
+
+    for (int i = 0; i < s->n; i++) {
+        x = s->set[i];
+        for (int e = d->step_idx[x]; e < d->step_idx[x+1]; e++) {
+            if (sm_event_match(d->fsm, d->machine+d->step[e].via,
+                               d->rep[c]))
+                dc->buf[n++] = d->step[e].to;
+        }
+    }
+    if (d->flags & DFA_UNANCHORED) dc->buf[n++] = d->seed;
+    k = closure(d, dc, dc->buf, n, 0);
+    to = lookup(d, dc, dc->work, k, false);
+    // a flush frees the state being left
+    if (to >= 0 && dc->nflush == nflush) s->next[c] = to;
+    return to;
+}
+
+/* Hopcroft's algorithm.  The states are partitioned by acceptance,
+ * then blocks are split until the states of each block agree on the
+ * block each byte class takes them to.  The blocks become the states
+ * of the compiled table. */
+static bool
+minimise(struct dfa* d, struct dfa_cache* dc)
+{
+    int n = dc->nstates, k = d->nclasses, nblocks = 0, nwork = 0;
+    int ntouched, nsplit, b, nb, t, x, pos, other;
+    int *inv_idx, *inv, *elems, *loc, *block, *first, *size, *marked;
+    int *work, *touched, *splitter;
+    bool* inwork;
+    struct dstate* ds;
+
+    inv_idx = mem_calloc(k * n + 1, sizeof(int));
+    inv = mem_alloc(k * n * sizeof(int));
+    elems = mem_alloc(9 * n * sizeof(int));
+    inwork = mem_calloc(n, sizeof(bool));
+    if (!inv_idx || !inv || !elems || !inwork) {
+        mem_free(inv_idx); mem_free(inv); mem_free(elems); mem_free(inwork);
+        return false;
+    }
+    loc = elems + n; block = loc + n; first = block + n; size = first + n;
+    marked = size + n; work = marked + n; touched = work + n;
+    splitter = touched + n;
+
+    // sources of each transition into t over c, in compressed rows
+    for (int s = 0; s < n; s++)
+        for (int c = 0; c < k; c++)
+            inv_idx[c * n + dc->states[s]->next[c] + 1]++;
+    for (int i = 0; i < k * n; i++) inv_idx[i+1] += inv_idx[i];
+    for (int s = 0; s < n; s++)
+        for (int c = 0; c < k; c++)
+            inv[inv_idx[c * n + dc->states[s]->next[c]]++] = s;
+    for (int i = k * n; i > 0; i--) inv_idx[i] = inv_idx[i-1];
+    inv_idx[0] = 0;
+
+    // initial partition, by acceptance
+    for (int a = 0, i = 0; a < 4; a++) {
+        // nblocks may be n already, write to its block only if used
+        pos = i;
+        for (int s = 0; s < n; s++) {
+            ds = dc->states[s];
+            if (ds->accept + 2 * ds->accept_end != a) continue;
+            elems[i] = s;
+            loc[s] = i++;
+            block[s] = nblocks;
+        }
+        if (i > pos) {
+            first[nblocks] = pos;
+            size[nblocks] = i - pos;
+            marked[nblocks] = 0;
+            inwork[nblocks] = true;
+            work[nwork++] = nblocks++;
+        }
+    }
+
+    while (nwork > 0) {
+        b = work[--nwork];
+        inwork[b] = false;
+        nsplit = size[b];
+        memcpy(splitter, elems + first[b], nsplit * sizeof(int));
+        for (int c = 0; c < k; c++) {
+            // move the states entering the splitter over c to the
+            // front of their blocks
+            ntouched = 0;
+            for (int i = 0; i < nsplit; i++) {
+                t = splitter[i];
+                for (int e = inv_idx[c*n+t]; e < inv_idx[c*n+t+1]; e++) {
+                    x = inv[e];
+                    nb = block[x];
+                    if (marked[nb] == 0) touched[ntouched++] = nb;
+                    pos = first[nb] + marked[nb]++;
+                    other = elems[pos];
+                    elems[pos] = x;
+                    elems[loc[x]] = other;
+                    loc[other] = loc[x];
+                    loc[x] = pos;
+                }
+            }
+            // split the blocks only partly entered
+            for (int i = 0; i < ntouched; i++) {
+                b = touched[i];
+                if (marked[b] < size[b]) {
+                    nb = nblocks++;
+                    first[nb] = first[b];
+                    size[nb] = marked[b];
+                    marked[nb] = 0;
+                    first[b] += marked[b];
+                    size[b] -= marked[b];
+                    for (int j = first[nb]; j < first[b]; j++)
+                        block[elems[j]] = nb;
+                    if (inwork[b] || size[nb] <= size[b]) {
+                        inwork[nb] = true;
+                        work[nwork++] = nb;
+                    }
+                    else {
+                        inwork[b] = true;
+                        work[nwork++] = b;
+                    }
+                }
+                marked[b] = 0;
+            }
+        }
+    }
+
+    d->table = arena_alloc(d->fsm->arena, nblocks * k * sizeof(int));
+    d->accepts = arena_alloc(d->fsm->arena, nblocks);
+    if (d->table && d->accepts) {
+        d->tdead = DFA_NO_MATCH;
+        for (b = 0; b < nblocks; b++) {
+            ds = dc->states[elems[first[b]]];
+            d->accepts[b] = ds->accept + 2 * ds->accept_end;
+            bool dead = d->accepts[b] == 0;
+            for (int c = 0; c < k; c++) {
+                d->table[b * k + c] = block[ds->next[c]];
+                dead &= d->table[b * k + c] == b;
+            }
+            if (dead) d->tdead = b;
+        }
+        d->tinit[0] = block[dc->init[0]];
+        d->tinit[1] = block[dc->init[1]];
+        d->ntable = nblocks;
+        DEBUGV("dfa: %d states, minimised to %d\n", n, nblocks);
+    }
+    mem_free(inv_idx); mem_free(inv); mem_free(elems); mem_free(inwork);
+    return d->table && d->accepts;
+}
+
+/* Build every state of the DFA, then minimise it to a table.  Returns
+ * false, leaving the DFA lazy, if it would be too large. */
+bool
+dfa_compile(struct dfa* d)
+{
+    struct dfa_cache* dc;
+    bool ok;
+
+    if ((dc = cache_init(d, DFA_MAX_FULL)) == NULL) return false;
+    dc->nflush = DFA_MAX_FLUSH;  // fail rather than flush
+    ok = initial(d, dc, false) >= 0 && initial(d, dc, true) >= 0;
+    for (int s = 0; ok && s < dc->nstates; s++) {
+        for (int c = 0; ok && c < d->nclasses; c++) {
+            if (dc->states[s]->next[c] == DFA_UNKNOWN)
+                ok = transition(d, dc, s, c) >= 0;
+        }
+    }
+    if (ok) ok = minimise(d, dc);
+    if (!ok) {
+        DEBUGV("dfa: not compiled, %d states\n", dc->nstates);
+    }
+    dfa_cache_free(dc);
+    return ok;
+}
+
+/* Native code for the compiled DFA.  Returns false, leaving the
+ * table to be used, if there can be none. */
+bool
+dfa_jit(struct dfa* d)
+{
+    struct jit_dfa jd;
+
+    if (d->table == NULL) return false;
+    jd.table = d->table;
+    jd.accepts = d->accepts;
+    jd.classes = d->classes;
+    jd.nstates = d->ntable;
+    jd.nclasses = d->nclasses;
+    jd.init[0] = d->tinit[0];
+    jd.init[1] = d->tinit[1];
+    jd.dead = d->tdead;
+    jd.reverse = d->flags & DFA_REVERSE;
+    d->jit = jit_dfa(&jd, &d->jit_mem, &d->jit_size);
+    return d->jit != NULL;
+}
+
+/* Write C source for the scan of the compiled DFA, as a function
+ * static int name(const char* s, int len, int from) with the same
+ * result as dfa_scan.  Each state is a label, with a switch on the
+ * byte class of the next byte.  Returns false if not compiled. */
+bool
+dfa_generate(struct dfa* d, FILE* fp, const char* name)
+{
+    bool rev = d->flags & DFA_REVERSE;
+    int k = d->nclasses, common = 0, n, most;
+    bool done[256];
+
+    if (d->table == NULL) return false;
+    fprintf(fp, "static const unsigned char %s_classes[256] = {", name);
+    for (int c = 0; c < 256; c++)
+        fprintf(fp, "%s%3d,", (c % 16 == 0)?"\n    ":" ", d->classes[c]);
+    fprintf(fp, "\n};\n\n");
+    fprintf(fp, "static int\n%s(const char* s, int len, int from)\n{\n",
+            name);
+    fprintf(fp, "    int j = from, last = %d;\n\n", DFA_NO_MATCH);
+    // not every scan looks at both
+    fprintf(fp, "    (void) len;\n    (void) last;\n");
+    if (d->tinit[1] != d->tinit[0])
+        fprintf(fp, "    if (from == %s) goto s%d;\n", rev?"len":"0",
+                d->tinit[1]);
+    fprintf(fp, "    goto s%d;\n", d->tinit[0]);
+    for (int b = 0; b < d->ntable; b++) {
+        fprintf(fp, "s%d:\n", b);
+        if (b == d->tdead) {
+            fprintf(fp, "    return last;\n");
+            continue;
+        }
+        fprintf(fp, "    if (j == %s) return %s;\n", rev?"0":"len",
+                (d->accepts[b] & 2)?"j":"last");
+        if (d->accepts[b] & 1) fprintf(fp, "    last = j;\n");
+        fprintf(fp, "    switch (%s_classes[(unsigned char) s[%s]]) {",
+                name, rev?"--j":"j++");
+        // the most common next state is the default
+        most = 0;
+        for (int c = 0; c < k; c++) {
+            n = 0;
+            for (int e = 0; e < k; e++)
+                n += d->table[b * k + e] == d->table[b * k + c];
+            if (n > most) {
+                most = n;
+                common = d->table[b * k + c];
+            }
+        }
+        memset(done, 0, sizeof(done));
+        for (int c = 0; c < k; c++) {
+            int t = d->table[b * k + c];
+
+            if (t == common || done[c]) continue;
+            n = 0;
+            for (int e = c; e < k; e++) {
+                if (d->table[b * k + e] != t) continue;
+                done[e] = true;
+                fprintf(fp, "%s case %d:", (n++ % 8 == 0)?"\n       ":"", e);
+            }
+            fprintf(fp, "\n            goto s%d;", t);
+        }
+        fprintf(fp, "\n        default:\n            goto s%d;\n    }\n",
+                common);
+    }
+    fprintf(fp, "}\n");
+    return true;
+}
+
+/* Scan with the compiled table */
+static int
+table_scan(struct dfa* d, const char* s, int len, int from)
+{
+    bool rev = d->flags & DFA_REVERSE;
+    int j = from, end = rev?0:len, last = DFA_NO_MATCH, k = d->nclasses;
+    int state = d->tinit[from == (rev?len:0)];
+
+    while (true) {
+        if (d->accepts[state] & ((j == end)?2:1)) last = j;
+        if (j == end || state == d->tdead) break;
+        if (rev)
+            state = d->table[state * k + d->classes[(unsigned char) s[--j]]];
+        else
+            state = d->table[state * k + d->classes[(unsigned char) s[j++]]];
+    }
+    return last;
+}
+
+/* Scan the string s, of length len, from position from until its
+ * start or end or until no match is possible.  Returns the last
+ * position at which the DFA accepted, DFA_NO_MATCH or DFA_FAILED.
+ * A lazy DFA builds its states in the cache dc. */
+int
+dfa_scan(struct dfa* d, struct dfa_cache* dc, const char* s, int len, int from)
+{
+    bool rev = d->flags & DFA_REVERSE;
+    int j = from, end = rev?0:len, last = DFA_NO_MATCH, state, next;
+    struct dstate* ds;
+
+    if (d->jit) return d->jit(s, len, from);
+    if (d->table) return table_scan(d, s, len, from);
+    if (dc == NULL) return DFA_FAILED;
+    dc->nflush = 0;
+    if ((state = initial(d, dc, from == (rev?len:0))) < 0) return DFA_FAILED;
+    while (true) {
+        ds = dc->states[state];
+        if (j == end?ds->accept_end:ds->accept) last = j;
+        if (j == end || ds->n == 0) break;
+        next = ds->next[d->classes[(unsigned char) s[rev?j-1:j]]];
+        if (next == DFA_UNKNOWN) {
+            next = transition(d, dc, state,
+                              d->classes[(unsigned char) s[rev?j-1:j]]);
+            if (next < 0) return DFA_FAILED;
+        }
+        state = next;
+        j += rev?-1:1;
+    }
+    return last;
+}
@@ -0,0 +1,27 @@
+#ifndef DFA_H
+#define DFA_H
+
+#include <stdio.h>
+
+#include "sm.h"
+
+/* dfa_init flags and dfa_scan results */
+enum {
+    DFA_REVERSE = 1,            // scan from the end of the string
+    DFA_UNANCHORED = 2,         // implicit .* before the expression
+    DFA_NO_MATCH = -1,
+    DFA_FAILED = -2             // state cache thrashing, use the NFA
+};
+
+struct dfa* dfa_init(struct sm_fsm*, int);
+bool dfa_compile(struct dfa*);
+bool dfa_jit(struct dfa*);
+bool dfa_generate(struct dfa*, FILE*, const char*);
+void dfa_free(struct dfa*);
+size_t dfa_size(struct dfa*);
+size_t dfa_code_size(struct dfa*);
+struct dfa_cache* dfa_cache_init(struct dfa*);
+void dfa_cache_free(struct dfa_cache*);
+int dfa_scan(struct dfa*, struct dfa_cache*, const char*, int, int);
+
+#endif
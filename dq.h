@@ -1,15 +0,0 @@
-#ifndef DQ_H
-#define DQ_H
-
-int dq_init(int);
-int dq_push_head(int);
-int dq_push_tail(int);
-int dq_pop_head(void);
-int dq_pop_tail(void);
-int dq_peek_head(void);
-int dq_peek_tail(void);
-int dq_empty(void);
-void dq_print(void);
-
-
-#endif
@@ -0,0 +1,277 @@
+/* Bit-parallel Glushkov automaton
+ *
+ * The positions of a pattern are the states of the state machine that
+ * consume a character.  In the Glushkov automaton for the pattern
+ * every transition into a position is over that position's character,
+ * so with the set of positions active as a bit mask, a step over byte
+ * c is
+ *
+ *      D' = Follow(D) & B[c]
+ *
+ * where B[c] is the positions matching c and Follow(D) the union of
+ * the follow sets of the positions in D.  Follow(D) is looked up in
+ * tables by 8 positions at a time, so a step is a few table lookups,
+ * ORs and an AND, with no queue and no allocation.  Up to 64 positions
+ * fit a word, up to 128 two.
+ *
+ * As with the DFA, a reverse scan over the preceding sets finds where
+ * the leftmost match starts, and a forward scan from there its end.
+ * '^' can only be passed before the first position and '$' only after
+ * the last, so the anchors are folded into the first and last sets.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "re.h"
+#include "sm.h"
+#include "glushkov.h"
+#include "mem.h"
+
+enum {
+    GK_WORDS = GK_MAX_POSITIONS / 64
+};
+
+typedef uint64_t gk_set[GK_WORDS];
+
+struct glushkov {
+    int npos;
+    int words;                  // in use in each set
+    int nchunks;                // 8 position chunks in use
+    gk_set* b;                  // positions matching each byte
+    gk_set* follow;             // [nchunks][256], union of follow sets
+    gk_set* precede;            // and of preceding sets, by chunk
+    gk_set first[2];            // by at start of string
+    gk_set last[2];             // by at end of string
+    bool empty[2][2];           // matches empty, by at start and at end
+};
+
+/* Work areas for building the automaton */
+struct build {
+    struct sm_fsm* fsm;
+    int* pos;                   // position of each state, or -1
+    char* mark;
+    int* stack;
+    int* visited;               // states marked, to clear the marks
+};
+
+static inline void
+add(gk_set set, int p)
+{
+    set[p / 64] |= (uint64_t) 1 << (p % 64);
+}
+
+/* The positions reached over epsilon transitions from state, passing
+ * '^' or '$' only if allowed.  Returns true if the accept state is
+ * reached. */
+static bool
+closure(struct build* bd, int state, bool bol, bool eol, gk_set set)
+{
+    int sp = 0, n = 0;
+    struct sm_entry* st;
+    bool accept = false;
+
+    memset(set, 0, sizeof(gk_set));
+    bd->stack[sp++] = state;
+    while (sp > 0) {
+        state = bd->stack[--sp];
+        if (bd->mark[state]) continue;
+        bd->mark[state] = true;
+        bd->visited[n++] = state;
+        st = bd->fsm->fsm+state;
+        if (state == 0)
+            accept = true;
+        else if (st->event == RE_NODE) {
+            bd->stack[sp++] = st->next2;
+            bd->stack[sp++] = st->next1;
+        }
+        else if (st->event == RE_BOL) {
+            if (bol) bd->stack[sp++] = st->next1;
+        }
+        else if (st->event == RE_EOL) {
+            if (eol) bd->stack[sp++] = st->next1;
+        }
+        else {
+            add(set, bd->pos[state]);
+        }
+    }
+    for (int i = 0; i < n; i++) bd->mark[bd->visited[i]] = false;
+    return accept;
+}
+
+/* Tables of the unions of the sets by position, 8 positions at a
+ * time */
+static void
+chunk_tables(struct glushkov* g, gk_set* sets, gk_set* table)
+{
+    for (int k = 0; k < g->nchunks; k++) {
+        gk_set* t = table + 256 * k;
+
+        memset(t[0], 0, sizeof(gk_set));
+        for (int b = 1; b < 256; b++) {
+            int p = 8 * k + __builtin_ctz(b);
+
+            for (int w = 0; w < GK_WORDS; w++)
+                t[b][w] = t[b & (b - 1)][w] |
+                    (p < g->npos?sets[p][w]:0);
+        }
+    }
+}
+
+/* The automaton for fsm, allocated from its arena, or NULL if it has
+ * too many positions */
+struct glushkov*
+gk_init(struct sm_fsm* fsm)
+{
+    struct glushkov* g;
+    struct build bd;
+    int m = fsm->max_state + 1, n = 0;
+    gk_set* follow, *precede, last_end, set;
+    bool accept;
+
+    for (int u = 1; u < m; u++) {
+        if (fsm->fsm[u].event != RE_NODE && fsm->fsm[u].event != RE_BOL
+            && fsm->fsm[u].event != RE_EOL) n++;
+    }
+    if (n > GK_MAX_POSITIONS) return NULL;
+    g = arena_calloc(fsm->arena, 1, sizeof(struct glushkov));
+    if (g == NULL) return NULL;
+    g->npos = n;
+    g->words = (n + 63) / 64;
+    g->nchunks = (n + 7) / 8;
+    bd.fsm = fsm;
+    bd.pos = mem_alloc(m * sizeof(int));
+    bd.mark = mem_calloc(m, sizeof(char));
+    bd.stack = mem_alloc((2 * m + 1) * sizeof(int));
+    bd.visited = mem_alloc(m * sizeof(int));
+    follow = mem_calloc(n + 1, sizeof(gk_set));
+    precede = mem_calloc(n + 1, sizeof(gk_set));
+    g->b = arena_calloc(fsm->arena, 256, sizeof(gk_set));
+    g->follow = arena_alloc(fsm->arena,
+                            256 * (g->nchunks + 1) * sizeof(gk_set));
+    g->precede = arena_alloc(fsm->arena,
+                             256 * (g->nchunks + 1) * sizeof(gk_set));
+    if (!bd.pos || !bd.mark || !bd.stack || !bd.visited || !follow ||
+        !precede || !g->b || !g->follow || !g->precede) {
+        mem_free(bd.pos);
+        mem_free(bd.mark);
+        mem_free(bd.stack);
+        mem_free(bd.visited);
+        mem_free(follow);
+        mem_free(precede);
+        return NULL;
+    }
+    n = 0;
+    for (int u = 0; u < m; u++) {
+        struct sm_entry* st = fsm->fsm+u;
+
+        bd.pos[u] = -1;
+        if (u == 0 || st->event == RE_NODE || st->event == RE_BOL ||
+            st->event == RE_EOL) continue;
+        bd.pos[u] = n++;
+        for (int c = 0; c < 256; c++) {
+            if (sm_event_match(fsm, st, c))
+                add(g->b[c], bd.pos[u]);
+        }
+    }
+    for (int a = 0; a < 2; a++) {
+        for (int e = 0; e < 2; e++)
+            g->empty[a][e] = closure(&bd, fsm->fsm->next1, a, e, set);
+        // a position can't follow '$', there is nothing left to match
+        closure(&bd, fsm->fsm->next1, a, false, g->first[a]);
+    }
+    // nor can '^' be passed once a character is matched
+    for (int u = 1; u < m; u++) {
+        int p = bd.pos[u];
+
+        if (p < 0) continue;
+        accept = closure(&bd, fsm->fsm[u].next1, false, false, follow[p]);
+        if (accept) add(g->last[0], p);
+        if (closure(&bd, fsm->fsm[u].next1, false, true, last_end))
+            add(g->last[1], p);
+    }
+    for (int p = 0; p < g->npos; p++) {
+        for (int q = 0; q < g->npos; q++) {
+            if (follow[p][q / 64] >> (q % 64) & 1)
+                add(precede[q], p);
+        }
+    }
+    chunk_tables(g, follow, g->follow);
+    chunk_tables(g, precede, g->precede);
+    DEBUGV("glushkov: %d positions\n", g->npos);
+    mem_free(bd.pos);
+    mem_free(bd.mark);
+    mem_free(bd.stack);
+    mem_free(bd.visited);
+    mem_free(follow);
+    mem_free(precede);
+    return g;
+}
+
+size_t
+gk_size(struct glushkov* g)
+{
+    if (g == NULL) return 0;
+    return sizeof(struct glushkov)
+        + (256 + 2 * 256 * (g->nchunks + 1)) * sizeof(gk_set);
+}
+
+/* to = the union of the sets in table for the positions in from */
+static inline void
+expand(struct glushkov* g, gk_set* table, gk_set from, gk_set to)
+{
+    for (int w = 0; w < GK_WORDS; w++) to[w] = 0;
+    for (int k = 0; k < g->nchunks; k++) {
+        unsigned b = from[k / 8] >> (8 * (k % 8)) & 0xff;
+
+        if (b == 0) continue;
+        for (int w = 0; w < g->words; w++) to[w] |= table[256 * k + b][w];
+    }
+}
+
+static inline bool
+intersects(struct glushkov* g, gk_set a, gk_set b)
+{
+    uint64_t r = 0;
+
+    for (int w = 0; w < g->words; w++) r |= a[w] & b[w];
+    return r != 0;
+}
+
+/* Find the leftmost-longest match in the len bytes at s, returning its
+ * start and end */
+bool
+gk_match(struct glushkov* g, const char* s, int len, int* start, int* end)
+{
+    gk_set d = {0}, t;
+    unsigned char c;
+    int j;
+
+    // d is the positions at j from which the rest of a match follows
+    *start = g->empty[len == 0][1]?len:-1;
+    for (j = len - 1; j >= 0; j--) {
+        c = s[j];
+        expand(g, g->precede, d, t);
+        for (int w = 0; w < g->words; w++)
+            d[w] = (t[w] | g->last[j + 1 == len][w]) & g->b[c][w];
+        if (intersects(g, d, g->first[j == 0]) || g->empty[j == 0][0])
+            *start = j;
+    }
+    if (*start < 0) return false;
+    // and from the start, d is the positions matched up to j
+    j = *start;
+    *end = g->empty[j == 0][j == len]?j:-1;
+    for (int w = 0; w < g->words; w++) d[w] = g->first[j == 0][w];
+    while (j < len) {
+        c = s[j++];
+        for (int w = 0; w < g->words; w++) d[w] &= g->b[c][w];
+        if (intersects(g, d, g->last[j == len])) *end = j;
+        expand(g, g->follow, d, t);
+        for (int w = 0; w < g->words; w++) d[w] = t[w];
+        if (!intersects(g, d, d)) break;
+    }
+    return true;
+}
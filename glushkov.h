@@ -0,0 +1,16 @@
+#ifndef GLUSHKOV_H
+#define GLUSHKOV_H
+
+#include <stdbool.h>
+
+#include "sm.h"
+
+enum {
+    GK_MAX_POSITIONS = 128
+};
+
+struct glushkov* gk_init(struct sm_fsm*);
+size_t gk_size(struct glushkov*);
+bool gk_match(struct glushkov*, const char*, int, int*, int*);
+
+#endif
@@ -0,0 +1,261 @@
+/* x86-64 code for compiled DFAs
+ *
+ * Each state of a compiled DFA becomes a block of code that checks
+ * for the end of the scan, records a match if the state accepts, loads
+ * the next byte and branches to the block for the next state.  States
+ * whose transitions fall into a few runs of bytes branch by comparing
+ * against the end of each run, others through a table of 256 offsets.
+ * The scan keeps s in rdi, the position in r8, the end in r9 and the
+ * last match in eax, so a byte costs a load, a compare or two and a
+ * branch, with no memory traffic for the state.
+ *
+ * The code is written to a buffer, copied to pages from mmap and made
+ * executable, never writable and executable at once.  Elsewhere than
+ * x86-64, or if the pages can't be had, there is no code and the
+ * table is used.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X86_64
+#endif
+
+#include "re.h"
+#include "jit.h"
+#include "mem.h"
+
+#ifdef JIT_X86_64
+
+enum {
+    JIT_MAX_RUNS = 8,           // compare and branch up to this many
+    JIT_ALLOC_SIZE = 4096
+};
+
+/* A 32 bit field to fill in with the offset of a state's code,
+ * relative to the end of the field or, for jump tables, to base */
+struct fixup {
+    int pos;
+    int state;
+    int base;                   // or -1
+};
+
+struct code {
+    unsigned char* buf;
+    int len;
+    int size;
+    struct fixup* fixups;
+    int nfixups;
+    int max_fixups;
+    bool ok;
+};
+
+static void
+emit(struct code* c, const unsigned char* bytes, int n)
+{
+    unsigned char* buf;
+
+    if (!c->ok) return;
+    if (c->len + n > c->size) {
+        if ((buf = mem_realloc(c->buf, c->size + n + JIT_ALLOC_SIZE)) == NULL) {
+            c->ok = false;
+            return;
+        }
+        c->buf = buf;
+        c->size += n + JIT_ALLOC_SIZE;
+    }
+    memcpy(c->buf + c->len, bytes, n);
+    c->len += n;
+}
+
+#define EMIT(c, ...)                                            \
+    do {                                                        \
+        static const unsigned char b_[] = { __VA_ARGS__ };      \
+        emit((c), b_, sizeof(b_));                              \
+    } while (0)
+
+static void
+emit32(struct code* c, int v)
+{
+    unsigned char b[4] = { v, v >> 8, v >> 16, v >> 24 };
+
+    emit(c, b, 4);
+}
+
+/* A 32 bit offset to the code for state, filled in later */
+static void
+emit_ref(struct code* c, int state, int base)
+{
+    struct fixup* f;
+
+    if (!c->ok) return;
+    if (c->nfixups == c->max_fixups) {
+        f = mem_realloc(c->fixups, (c->max_fixups + JIT_ALLOC_SIZE)
+                    * sizeof(struct fixup));
+        if (f == NULL) {
+            c->ok = false;
+            return;
+        }
+        c->fixups = f;
+        c->max_fixups += JIT_ALLOC_SIZE;
+    }
+    c->fixups[c->nfixups].pos = c->len;
+    c->fixups[c->nfixups].state = state;
+    c->fixups[c->nfixups++].base = base;
+    emit32(c, 0);
+}
+
+/* The code for state b of the DFA */
+static void
+emit_state(struct code* c, struct jit_dfa* d, int b)
+{
+    int next[256], hi[256], target[256], nruns = 0, base;
+
+    if (b == d->dead) {
+        EMIT(c, 0xc3);                          // ret
+        return;
+    }
+    EMIT(c, 0x4d, 0x39, 0xc8);                  // cmp r8, r9
+    if (d->accepts[b] & 2) {
+        EMIT(c, 0x75, 0x04);                    // jne over
+        EMIT(c, 0x44, 0x89, 0xc0);              // mov eax, r8d
+    }
+    else {
+        EMIT(c, 0x75, 0x01);                    // jne over
+    }
+    EMIT(c, 0xc3);                              // ret
+    if (d->accepts[b] & 1)
+        EMIT(c, 0x44, 0x89, 0xc0);              // mov eax, r8d
+    if (d->reverse) {
+        EMIT(c, 0x49, 0xff, 0xc8);              // dec r8
+        EMIT(c, 0x42, 0x0f, 0xb6, 0x0c, 0x07);  // movzx ecx, [rdi+r8]
+    }
+    else {
+        EMIT(c, 0x42, 0x0f, 0xb6, 0x0c, 0x07);  // movzx ecx, [rdi+r8]
+        EMIT(c, 0x49, 0xff, 0xc0);              // inc r8
+    }
+    for (int i = 0; i < 256; i++) {
+        next[i] = d->table[b * d->nclasses + d->classes[i]];
+        if (i > 0 && next[i] == next[i-1])
+            hi[nruns-1] = i;
+        else {
+            hi[nruns] = i;
+            target[nruns++] = next[i];
+        }
+    }
+    if (nruns <= JIT_MAX_RUNS) {
+        for (int r = 0; r < nruns - 1; r++) {
+            if (hi[r] < 128) {
+                EMIT(c, 0x83, 0xf9);            // cmp ecx, imm8
+                emit(c, (unsigned char[]) { hi[r] }, 1);
+            }
+            else {
+                EMIT(c, 0x81, 0xf9);            // cmp ecx, imm32
+                emit32(c, hi[r]);
+            }
+            EMIT(c, 0x0f, 0x86);                // jbe state
+            emit_ref(c, target[r], -1);
+        }
+        EMIT(c, 0xe9);                          // jmp state
+        emit_ref(c, target[nruns-1], -1);
+        return;
+    }
+    EMIT(c, 0x48, 0x8d, 0x15, 0x0c, 0, 0, 0);   // lea rdx, [rip+table]
+    EMIT(c, 0x48, 0x63, 0x0c, 0x8a);            // movsxd rcx, [rdx+rcx*4]
+    EMIT(c, 0x48, 0x01, 0xd1);                  // add rcx, rdx
+    EMIT(c, 0xff, 0xe1);                        // jmp rcx
+    EMIT(c, 0x90, 0x90, 0x90);                  // pad, table follows
+    base = c->len;
+    for (int i = 0; i < 256; i++) emit_ref(c, next[i], base);
+}
+
+/* Native code for the scan of DFA d, returning the function and, in
+ * mem and size, the pages to free with jit_free.  NULL if there can't
+ * be code, and size is 0. */
+jit_scan
+jit_dfa(struct jit_dfa* d, void** mem, size_t* size)
+{
+    struct code c = { .ok = true };
+    int* at, pos, v;
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages;
+    void* p;
+
+    *size = 0;
+    if (d->nstates > JIT_MAX_STATES) return NULL;
+    if ((at = mem_alloc(d->nstates * sizeof(int))) == NULL) return NULL;
+    EMIT(&c, 0x4c, 0x63, 0xc2);                 // movsxd r8, edx
+    if (d->reverse) {
+        EMIT(&c, 0x45, 0x31, 0xc9);             // xor r9d, r9d
+        EMIT(&c, 0x39, 0xf2);                   // cmp edx, esi
+    }
+    else {
+        EMIT(&c, 0x4c, 0x63, 0xce);             // movsxd r9, esi
+        EMIT(&c, 0x85, 0xd2);                   // test edx, edx
+    }
+    EMIT(&c, 0xb8, 0xff, 0xff, 0xff, 0xff);     // mov eax, -1
+    EMIT(&c, 0x0f, 0x84);                       // je initial at start
+    emit_ref(&c, d->init[1], -1);
+    EMIT(&c, 0xe9);                             // jmp initial
+    emit_ref(&c, d->init[0], -1);
+    for (int b = 0; b < d->nstates; b++) {
+        at[b] = c.len;
+        emit_state(&c, d, b);
+    }
+    for (int i = 0; c.ok && i < c.nfixups; i++) {
+        pos = c.fixups[i].pos;
+        v = at[c.fixups[i].state] - ((c.fixups[i].base < 0)?
+                                     pos + 4:c.fixups[i].base);
+        memcpy(c.buf + pos, &v, 4);
+    }
+    mem_free(at);
+    mem_free(c.fixups);
+    if (!c.ok) {
+        mem_free(c.buf);
+        return NULL;
+    }
+    pages = (c.len + page - 1) / page * page;
+    p = mmap(NULL, pages, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS,
+             -1, 0);
+    if (p == MAP_FAILED) {
+        mem_free(c.buf);
+        return NULL;
+    }
+    memcpy(p, c.buf, c.len);
+    mem_free(c.buf);
+    if (mprotect(p, pages, PROT_READ|PROT_EXEC) != 0) {
+        munmap(p, pages);
+        return NULL;
+    }
+    // only code in place is counted
+    *mem = p;
+    *size = pages;
+    DEBUGV("jit: %d states, %d bytes of code\n", d->nstates, c.len);
+    return (jit_scan) p;
+}
+
+void
+jit_free(void* mem, size_t size)
+{
+    if (mem != NULL) munmap(mem, size);
+}
+
+#else
+
+jit_scan
+jit_dfa(struct jit_dfa* d, void** mem, size_t* size)
+{
+    *size = 0;
+    return NULL;
+}
+
+void
+jit_free(void* mem, size_t size)
+{
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum {
+    JIT_MAX_STATES = 1024
+};
+
+/* a compiled DFA scan, as dfa_scan(d, NULL, s, len, from) */
+typedef int (*jit_scan)(const char*, int, int);
+
+/* The DFA table for jit_dfa */
+struct jit_dfa {
+    const int* table;               // next state, by state and byte class
+    const unsigned char* accepts;   // 1 accepting, 2 accepting at the end
+    const unsigned char* classes;   // byte class of each byte
+    int nstates;
+    int nclasses;
+    int init[2];                    // initial state, by at start
+    int dead;                       // or DFA_NO_MATCH if none
+    bool reverse;
+};
+
+jit_scan jit_dfa(struct jit_dfa*, void**, size_t*);
+void jit_free(void*, size_t);
+
+#endif
@@ -0,0 +1,283 @@
+/* Memory
+ *
+ * All the memory the library uses comes from the allocator set with
+ * re_set_allocator, malloc, realloc and free unless one is.  Work areas
+ * and scratches take and give back memory as they need it.
+ *
+ * What a compiled regex keeps is carved from an arena of its own:
+ * blocks taken from the allocator, each used up in order before the
+ * next.  An allocation too large to fit a block well has a block to
+ * itself.  Nothing is freed on its own; the blocks go back together
+ * when the regex is freed, to the allocator the arena was made with.  An
+ * arena can be released back to a mark, dropping what was allocated
+ * since, for attempts given up on and caches flushed.  The blocks
+ * released are kept to be used again, so an arena filled and released
+ * over and over stops taking memory once it has enough.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdalign.h>
+#include <stdbool.h>
+
+#include "re.h"
+#include "mem.h"
+
+
+struct block {
+    struct block* next;         // older
+    int seq;                    // order made in
+    size_t size;                // of data
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+struct arena {
+    struct re_allocator allocator;
+    struct block* blocks;       // the one in use first
+    struct block* spare;        // released, to be used again
+    size_t block;               // size of a block
+    int nblocks;                // made, including those released
+};
+
+static void*
+std_alloc(void* ctx, size_t size)
+{
+    (void) ctx;
+    return malloc(size);
+}
+
+static void*
+std_resize(void* ctx, void* p, size_t size)
+{
+    (void) ctx;
+    return realloc(p, size);
+}
+
+static void
+std_release(void* ctx, void* p)
+{
+    (void) ctx;
+    free(p);
+}
+
+static struct re_allocator allocator = {
+    std_alloc, std_resize, std_release, NULL
+};
+
+/* Use a for the memory allocated from now on, or malloc if a is NULL.
+ * Memory is always freed with the allocator it came from. */
+void
+re_set_allocator(const struct re_allocator* a)
+{
+    if (a == NULL) {
+        allocator.alloc = std_alloc;
+        allocator.resize = std_resize;
+        allocator.release = std_release;
+        allocator.ctx = NULL;
+    }
+    else
+        allocator = *a;
+}
+
+void*
+mem_alloc(size_t size)
+{
+    return allocator.alloc(allocator.ctx, size);
+}
+
+void*
+mem_calloc(size_t n, size_t size)
+{
+    void* p;
+
+    if (size != 0 && n > SIZE_MAX / size) return NULL;
+    if ((p = mem_alloc(n * size)) != NULL) memset(p, 0, n * size);
+    return p;
+}
+
+void*
+mem_realloc(void* p, size_t size)
+{
+    return allocator.resize(allocator.ctx, p, size);
+}
+
+void
+mem_free(void* p)
+{
+    if (p != NULL) allocator.release(allocator.ctx, p);
+}
+
+/* How to free what is allocated now, if the allocator may be changed
+ * before it is */
+void
+mem_owner(void (**release)(void*, void*), void** ctx)
+{
+    *release = allocator.release;
+    *ctx = allocator.ctx;
+}
+
+static size_t
+align(size_t size)
+{
+    return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+}
+
+static struct block*
+new_block(struct arena* a, const struct re_allocator* from, size_t size)
+{
+    struct block* b, **p;
+
+    for (p = &a->spare; *p != NULL; p = &(*p)->next) {
+        if ((*p)->size >= size) {
+            b = *p;
+            *p = b->next;
+            b->seq = a->nblocks++;
+            b->used = 0;
+            return b;
+        }
+    }
+    if (size > SIZE_MAX - sizeof(struct block)) return NULL;
+    if ((b = from->alloc(from->ctx, sizeof(struct block) + size)) == NULL)
+        return NULL;
+    b->seq = a->nblocks++;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+/* An empty arena taking blocks of size bytes from the allocator now
+ * set, the first holding the arena itself */
+struct arena*
+arena_init(size_t size)
+{
+    struct arena a = { .allocator = allocator, .block = size };
+    struct block* b;
+
+    if ((b = new_block(&a, &allocator, size)) == NULL) return NULL;
+    b->next = NULL;
+    b->used = align(sizeof(struct arena));
+    memcpy(b->data, &a, sizeof(struct arena));
+    ((struct arena*) b->data)->blocks = b;
+    return (struct arena*) b->data;
+}
+
+void*
+arena_alloc(struct arena* a, size_t size)
+{
+    struct block* b;
+
+    size = align(size);
+    b = a->blocks;
+    if (size <= b->size - b->used) {
+        b->used += size;
+        return b->data + b->used - size;
+    }
+    // a large allocation would waste most of a block
+    if (size > a->block / 4) {
+        if ((b = new_block(a, &a->allocator, size)) == NULL) return NULL;
+        b->used = size;
+        b->next = a->blocks->next;
+        a->blocks->next = b;
+        return b->data;
+    }
+    if ((b = new_block(a, &a->allocator, a->block)) == NULL) return NULL;
+    b->used = size;
+    b->next = a->blocks;
+    a->blocks = b;
+    return b->data;
+}
+
+void*
+arena_calloc(struct arena* a, size_t n, size_t size)
+{
+    void* p;
+
+    if (size != 0 && n > SIZE_MAX / size) return NULL;
+    if ((p = arena_alloc(a, n * size)) != NULL) memset(p, 0, n * size);
+    return p;
+}
+
+/* A copy of the size bytes at p */
+void*
+arena_copy(struct arena* a, const void* p, size_t size)
+{
+    void* copy;
+
+    if ((copy = arena_alloc(a, size)) != NULL) memcpy(copy, p, size);
+    return copy;
+}
+
+struct arena_mark
+arena_mark(struct arena* a)
+{
+    return (struct arena_mark) { a->blocks, a->blocks->used };
+}
+
+/* Free what was allocated since mark was taken, keeping the blocks */
+void
+arena_release(struct arena* a, struct arena_mark mark)
+{
+    struct block* b = mark.block, **p;
+    int seq = b->seq;
+
+    for (p = &a->blocks; *p != NULL; ) {
+        if ((*p)->seq > seq) {
+            b = *p;
+            *p = b->next;
+            b->next = a->spare;
+            a->spare = b;
+        }
+        else
+            p = &(*p)->next;
+    }
+    b = mark.block;
+    b->used = mark.used;
+    // the block marked is in use again, and only older ones remain
+    for (p = &a->blocks; *p != b; p = &(*p)->next)
+        ;
+    *p = b->next;
+    b->next = a->blocks;
+    a->blocks = b;
+}
+
+/* Bytes taken from the allocator, and in nblocks if it isn't NULL,
+ * how many blocks */
+size_t
+arena_size(struct arena* a, int* nblocks)
+{
+    size_t size = 0;
+    int n = 0;
+
+    for (struct block* b = a->blocks; b != NULL; b = b->next) {
+        size += sizeof(struct block) + b->size;
+        n++;
+    }
+    for (struct block* b = a->spare; b != NULL; b = b->next) {
+        size += sizeof(struct block) + b->size;
+        n++;
+    }
+    if (nblocks != NULL) *nblocks = n;
+    return size;
+}
+
+void
+arena_free(struct arena* a)
+{
+    struct re_allocator from;
+    struct block* b, *next;
+
+    if (a == NULL) return;
+    from = a->allocator;
+    for (b = a->spare; b != NULL; b = next) {
+        next = b->next;
+        from.release(from.ctx, b);
+    }
+    // the arena itself is in the last
+    for (b = a->blocks; b != NULL; b = next) {
+        next = b->next;
+        from.release(from.ctx, b);
+    }
+}
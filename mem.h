@@ -0,0 +1,31 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "re.h"
+
+struct arena;
+
+/* A point to release an arena back to */
+struct arena_mark {
+    void* block;
+    size_t used;
+};
+
+void* mem_alloc(size_t);
+void* mem_calloc(size_t, size_t);
+void* mem_realloc(void*, size_t);
+void mem_free(void*);
+void mem_owner(void (**)(void*, void*), void**);
+struct arena* arena_init(size_t);
+void* arena_alloc(struct arena*, size_t);
+void* arena_calloc(struct arena*, size_t, size_t);
+void* arena_copy(struct arena*, const void*, size_t);
+struct arena_mark arena_mark(struct arena*);
+void arena_release(struct arena*, struct arena_mark);
+size_t arena_size(struct arena*, int*);
+void arena_free(struct arena*);
+
+#endif
@@ -0,0 +1,85 @@
+/* State machine optimisation
+ *
+ * The states are emitted from the simplified syntax tree, which leaves
+ * no RE_NODE states that only pass on to another and none that no path
+ * reaches, so the chains of them the parser once left need no
+ * collapsing.  What is left to do is keep the states reachable from
+ * state 0, numbered in breadth first order, the order a search meets
+ * them, so that states used together sit together.  How many states
+ * were dropped is reported, and with the tree it is 0.
+ *
+ * State 0 remains the accept state, and its next1 the start.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "re.h"
+#include "sm.h"
+#include "opt.h"
+#include "mem.h"
+
+/* Keep the states reachable from state 0, numbered in breadth first
+ * order.  Returns the number dropped, or -1 if out of memory. */
+static int
+renumber(struct sm_fsm* fsm)
+{
+    int m = fsm->max_state + 1, n = 0, u, *order, *number;
+    struct sm_entry* st, *machine;
+
+    order = mem_alloc(m * sizeof(int));
+    number = mem_alloc(m * sizeof(int));
+    if (order == NULL || number == NULL) {
+        mem_free(order);
+        mem_free(number);
+        return -1;
+    }
+    for (u = 0; u < m; u++) number[u] = -1;
+    number[0] = 0;
+    order[n++] = 0;
+    for (int i = 0; i < n; i++) {
+        st = fsm->fsm+order[i];
+        // state 0's own transitions are the start and itself
+        int next[2] = { st->next1, (order[i] != 0 && st->event == RE_NODE)?
+                        st->next2:st->next1 };
+
+        for (int k = 0; k < 2; k++) {
+            if (number[next[k]] >= 0) continue;
+            number[next[k]] = n;
+            order[n++] = next[k];
+        }
+    }
+    if ((machine = mem_alloc(n * sizeof(struct sm_entry))) == NULL) {
+        mem_free(order);
+        mem_free(number);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        machine[i] = fsm->fsm[order[i]];
+        machine[i].next1 = number[machine[i].next1];
+        if (machine[i].event == RE_NODE)
+            machine[i].next2 = number[machine[i].next2];
+    }
+    mem_free(fsm->fsm);
+    fsm->fsm = machine;
+    fsm->max_state = n - 1;
+    fsm->nstates = n;
+    mem_free(order);
+    mem_free(number);
+    return m - n;
+}
+
+/* Run the passes over fsm, returning the number of states removed, or
+ * -1 if out of memory, leaving fsm as it was */
+int
+opt_run(struct sm_fsm* fsm)
+{
+    int removed;
+
+    if ((removed = renumber(fsm)) >= 0) {
+        DEBUGV("optimise: %d states removed, %d left\n", removed,
+               fsm->max_state + 1);
+    }
+    return removed;
+}
@@ -0,0 +1,8 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "sm.h"
+
+int opt_run(struct sm_fsm*);
+
+#endif
@@ -42,47 +42,180 @@
  * Remove matcher_mw (it's not good).
  * Implement character class match
  *
+ * Version 26
+ * Single pass matcher.  The start state is re-entered at every scan,
+ * rather than restarting the matcher at each offset of the search
+ * string, and duplicate states are no longer queued.  Linear in the
+ * length of the search string, so MAX_TRANSITIONS has gone.
+ *
+ * Version 27
+ * Lazy DFA (dfa.c), built from the state machine as it is used.  The
+ * matcher remains for when the DFA state cache thrashes.
+ *
+ * Version 28
+ * RE_DFA compiles the whole DFA, minimised, at re_compile.
+ *
+ * Version 29
+ * Compiler state is held in a context per call of re_compile, and the
+ * state machine is passed explicitly, so patterns may be compiled
+ * concurrently.  The pattern is no longer limited to 80 characters.
+ *
+ * Version 30
+ * Character classes are bitmaps, interned so that identical classes
+ * share one copy.
+ *
+ * Version 31
+ * The literal prefix every match must start with is taken from the
+ * state machine, and re_match skips to its occurrences with
+ * memchr/memmem before running the DFA or matcher.
+ *
+ * Version 32
+ * Otherwise a literal every match must contain is found, and a string
+ * without it is rejected by scanning for its least common byte.
+ *
+ * Version 33
+ * An alternation of plain literals is matched with an Aho-Corasick
+ * automaton (ac.c), whatever the number of alternates.
+ *
+ * Version 34
+ * Patterns starting with one of a small set of literals, including
+ * short alternations of literals, skip ahead with a Teddy SIMD search
+ * (teddy.c) for the set.
+ *
+ * Version 35
+ * A pattern with no special characters is searched for as a plain
+ * string (bmh.c), without a state machine.
+ *
+ * Version 36
+ * RE_BP matches patterns of up to 128 positions by bit-parallel
+ * simulation of their Glushkov automaton (glushkov.c).
+ *
+ * Version 37
+ * The matcher runs bytecode lowered from the state machine, with
+ * threaded dispatch.
+ *
+ * Version 38
+ * RE_JIT compiles the DFA to x86-64 code (jit.c).
+ *
+ * Version 39
+ * re_generate writes C source for a matcher of the pattern (ret -g).
+ *
+ * Version 40
+ * re_search takes a length, so strings needn't be terminated, and a
+ * position to search from; re_free frees a compiled regex.  re.hpp
+ * wraps them for C++.
+ *
+ * Version 41
+ * RE_OPT runs the optimisation passes of opt.c over the state machine,
+ * collapsing chains of RE_NODE states, dropping unreachable ones and
+ * numbering the rest in breadth first order.
+ *
+ * Version 42
+ * The parser builds a syntax tree (ast.c), from which the states are
+ * emitted.  This fixes closures after a dot closure, as in .*b*c*,
+ * which the patching of states in factor() left unreachable.  With
+ * RE_OPT the tree is first simplified: alternates factored and merged
+ * into classes, and nested closures flattened.  The states emitted
+ * from the tree leave opt.c none to collapse or drop, so it only
+ * numbers them.
+ *
+ * Version 43
+ * Runs of literal characters are lowered to one OP_STR, compared with
+ * memcmp, and the thread is held until the step after the literal.
+ *
+ * Version 44
+ * States are packed into 8 bytes, a RE_CC indexing a table of the
+ * machine's classes with next2, and trimmed to size once compiled.
+ * re_footprint reports the memory a compiled regex holds.
+ *
+ * Version 45
+ * A compiled regex is allocated from an arena of its own, freed at
+ * once, and re_set_allocator replaces malloc and free.
+ *
+ * Version 46
+ * re_match keeps a scratch for each of the last few regexes a thread
+ * matched, and the lazy DFA reuses its states' memory after a flush,
+ * so matching stops allocating once warmed up.
+ *
+ * Version 47
+ * The matcher lists threads in order of start and records the states
+ * entered at a step in a sparse set, entering each at most once, in
+ * place of the deque.
+ *
+ * Version 48
+ * re_scratch_budget limits the matcher steps a search may take, and a
+ * search that spends them is carried on by calling re_search again.
+ *
  */
 
+#define _GNU_SOURCE             // memmem
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <setjmp.h>
-#ifdef linux
-#include <bsd/string.h>
-#endif
+#include <stdatomic.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "re.h"
 #include "sm.h"
-#include "dq.h"
+#include "dfa.h"
+#include "ac.h"
+#include "teddy.h"
+#include "bmh.h"
+#include "glushkov.h"
+#include "opt.h"
+#include "ast.h"
+#include "mem.h"
 
 /* DEBUG macro for upto three integers */
-#define DEBUG(intro,a,b,c)                      \
-    if (debug) fprintf(stderr,"%s: "#a": %2d, "#b": %2d, "#c": %2d\n", \
-                       (intro), (a), (b), (c));                        \
+#define DEBUG(intro,a,b,c)                                          \
+    do {                                                            \
+        if (debug)                                                  \
+            fprintf(stderr,"%s: "#a": %2d, "#b": %2d, "#c": %2d\n", \
+                    (intro), (a), (b), (c));                        \
+    } while (0)
 
-/* DEBUG macro for printing varying number of args */
-#define DEBUGV(format, ...) \
-    if (debug) fprintf(stderr,format, __VA_ARGS__); \
-
-/* special tokens and constant limits
+/* special tokens and constant limits, in addition to the state
+ * events in sm.h
  * negative values for tokens requires signed char */
 enum {
-    RE_NODE = -1,
     RE_LP = -2,
     RE_RP = -3,
     RE_OR = -4,
     RE_CL = -5,
-    RE_BOL = -6,
-    RE_EOL = -7,
-    RE_DOT = -8,
     RE_SCAN = -9,
     RE_NO_MATCH = -10,
-    RE_CC = -11,
-    RE_NCC = -12,
-    LEXBUFSIZE = 81,
-    MAX_TRANSITIONS = 1000
+    REQUIRED_MAX_STATES = 2048, // limit on the required literal search
+    MATCH_POOL = 4              // scratches re_match keeps per thread
+};
+
+/* bytecode for the matcher */
+enum re_op {
+    OP_CHAR,                    // match c
+    OP_STR,                     // match the y characters at str
+    OP_CLASS,                   // match a member of cls
+    OP_ANY,                     // match any character
+    OP_SPLIT,                   // continue at x and at y
+    OP_JMP,                     // continue at x
+    OP_BOL,                     // at the start of the string
+    OP_EOL,                     // at the end of the string
+    OP_MATCH
+};
+
+/* Instructions are numbered as the states they were lowered from, so
+ * the matcher's work areas index both.  Instructions that match go on
+ * to x. */
+struct re_inst {
+    unsigned char op;
+    unsigned char c;            // OP_CHAR, and the first of OP_STR
+    int x;
+    int y;
+    union {
+        struct sm_class* cls;
+        const char* str;
+    };
 };
 
 char* error_msg[] = {
@@ -91,29 +224,58 @@ char* error_msg[] = {
     "malformed expression",
     "state transition limit exceeded",
     "failed to initialise state machine",
-    "unable to allocate memory for state machine"
+    "unable to allocate memory for state machine",
+    "DFA too large to generate code for",
+    "search budget exhausted"
 };
 
 bool debug = false;
 
-/* lexer buffer and pointer */
-static char lexbuf[LEXBUFSIZE];
-static char* lexnext;
+// numbers each compiled regex
+static atomic_ulong serial;
 
-/* character class buffer and pointer */
-static char ccbuf[LEXBUFSIZE];
-static char* ccnext;
+/* How common each byte is in text and logs, higher is more common.
+ * Used to pick the byte of a required literal to scan for. */
+static const unsigned char byte_freq[256] = {
+      5,   0,   0,   0,   0,   0,   0,   0,   0,  60,  60,   0,   0,  30,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    255,  40,  90,  40,  40,  40,  40,  70,  70,  70,  40,  40, 110, 120, 140, 110,
+    150, 150, 150, 150, 150, 150, 150, 150, 150, 150, 130,  40,  40,  90,  40,  40,
+     40, 112,  44,  76,  84, 120,  60,  56,  92, 104,  32,  36,  80,  68, 100, 108,
+     48,  24,  88,  96, 116,  72,  40,  64,  28,  52,  20,  60,  40,  60,  40,  90,
+     40, 232,  79, 151, 169, 250, 115, 106, 187, 214,  52,  61, 160, 133, 205, 223,
+     88,  34, 178, 196, 241, 142,  70, 124,  43,  97,  25,  40,  40,  40,  40,   0,
+      8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,
+      8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,
+      8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,
+      8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,
+      8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,
+      8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,
+      8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,
+      8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8,   8
+};
 
-/* forward decls */
-static int term(void);
-static int factor(void);
-static int expression(void);
+/* Compiler state, one per call of re_compile, so that patterns may be
+ * compiled concurrently */
+struct re_context {
+    char* lexbuf;               // lexer buffer, end and pointer
+    char* lexend;
+    char* lexnext;
+    bool started;               // plain character seen in alternate
+    int state;                  // next available state
+    struct ast_pool pool;       // the pattern's tree
+    struct sm_fsm* fsm;
+    jmp_buf env;
+};
 
-static jmp_buf env;
+/* forward decls */
+static struct ast* term(struct re_context*);
+static struct ast* factor(struct re_context*);
+static struct ast* expression(struct re_context*);
 
-// holds code for last error
+// holds code for last error, per thread
 // declared extern in header for use by client
-int re_error_code;
+_Thread_local int re_error_code;
 
 char*
 re_error_msg(void)
@@ -122,73 +284,89 @@ re_error_msg(void)
 }
 
 static void
-error(int error_code)
+error(struct re_context* ctx, int error_code)
 {
     re_error_code = error_code;
-    longjmp(env, error_code);
+    longjmp(ctx->env, error_code);
     return;
 }
 
-static size_t
-lexbuf_init(char* s)
+static void
+lexbuf_init(struct re_context* ctx, char* s)
 {
-    lexnext = lexbuf;
-    return strlcpy(lexbuf,s,LEXBUFSIZE);
+    ctx->lexbuf = ctx->lexnext = s;
+    ctx->lexend = s + strlen(s) + 1;
+    ctx->started = false;
 }
 
-static signed char
-parse_cc(void)
+static void
+insert(struct re_context* ctx, int state, signed char event,
+       int next1, int next2)
 {
-    signed char type = RE_CC, c;
+    if (state >= SM_MAX_STATES) error(ctx, RE_ERR_STL);
+    if (!sm_insert(ctx->fsm, state, event, next1, next2))
+        error(ctx, RE_ERR_MEM);
+}
 
-    ccnext = ccbuf;
-    c = *lexnext++;
-    while (c != ']' && lexnext < lexbuf + LEXBUFSIZE) {
+/* Parse a character class into a bitmap, returning the interned
+ * copy */
+static struct sm_class*
+parse_cc(struct re_context* ctx)
+{
+    unsigned char bits[SM_CLASS_BYTES] = {0};
+    unsigned char c, endc;
+    bool negate = false, first = true;
+    int last = -1;
+    struct sm_class* cls;
+
+    c = *ctx->lexnext++;
+    while (c != ']' && ctx->lexnext < ctx->lexend) {
         if (c == '\\') {
-            *ccnext++ = *lexnext++;
+            c = *ctx->lexnext++;
+            SM_CLASS_SET(bits, c);
+            last = c;
         }
-        else if (c == '^') {
-            if (ccnext == ccbuf) {
-                type = RE_NCC;
-            }
-            else {
-                *ccnext++ = c;
-            }
+        else if (c == '^' && first) {
+            negate = true;
         }
-        else if (c == '-') {
-            char endc = *lexnext++;
-            char t = *(ccnext-1)+1;
-            while (t != endc && ccnext < ccbuf+LEXBUFSIZE) *ccnext++ = t++;
-            *ccnext++ = endc;
+        else if (c == '-' && last >= 0 && *ctx->lexnext != ']') {
+            endc = *ctx->lexnext++;
+            for (int t = last+1; t <= endc; t++) SM_CLASS_SET(bits, t);
+            last = endc;
         }
         else {
-            *ccnext++ = c;
+            SM_CLASS_SET(bits, c);
+            last = c;
         }
-        c = *lexnext++;
+        first = false;
+        c = *ctx->lexnext++;
     }
-    if (c != ']') error(RE_ERR_EX);
-    *ccnext = '\0';
-    DEBUGV("ccbuf: %s\n",ccbuf);
-    return type;
+    if (c != ']') error(ctx, RE_ERR_EX);
+    if (negate) {
+        for (int i = 0; i < SM_CLASS_BYTES; i++) bits[i] = ~bits[i];
+    }
+    if ((cls = sm_class_intern(bits)) == NULL) error(ctx, RE_ERR_MEM);
+    DEBUGV("cc: %s, shared by %d\n", negate?"negated":"", cls->refs);
+    return cls;
 }
 
 static void
-unlexch(void)
+unlexch(struct re_context* ctx)
 {
-    if (lexnext > lexbuf) {
-        lexnext--;
-        if (*(lexnext-1) == '\\') lexnext--;
+    if (ctx->lexnext > ctx->lexbuf) {
+        ctx->lexnext--;
+        if (ctx->lexnext > ctx->lexbuf && *(ctx->lexnext-1) == '\\')
+            ctx->lexnext--;
     }
 }
 
 static signed char
-lexch(void)
+lexch(struct re_context* ctx)
 {
-    static bool started = false;
     signed char c = '\0';
 
-    if (lexnext < lexbuf+LEXBUFSIZE) {
-        c = *lexnext++;
+    if (ctx->lexnext < ctx->lexend) {
+        c = *ctx->lexnext++;
         switch (c) {
             case '(':
                 c = RE_LP;
@@ -198,20 +376,20 @@ lexch(void)
                 break;
             case '|':
                 c = RE_OR;
-                started = false;
+                ctx->started = false;
                 break;
             case '*':
                 c = RE_CL;
                 break;
             case '\\':
-                c = *lexnext++;
+                c = *ctx->lexnext++;
                 break;
             case '^':
-                c = started?c:RE_BOL;
+                c = ctx->started?c:RE_BOL;
                 break;
             case '$':
-                c = (*lexnext == '\0' || *lexnext == ')' ||
-                     *lexnext == '|')?RE_EOL:c;
+                c = (*ctx->lexnext == '\0' || *ctx->lexnext == ')' ||
+                     *ctx->lexnext == '|')?RE_EOL:c;
                 break;
             case '.':
                 c = RE_DOT;
@@ -221,225 +399,1316 @@ lexch(void)
                 break;
             default:
                 // plain character
-                started = true;
+                ctx->started = true;
                 break;
         }
     }
     return c;
 }
 
-/* Next available state */
-static int state;
-
-static int
-expression(void)
+/* The alternates of an expression, and the parts of a term, are
+ * gathered into one node each rather than nested, so the depth of the
+ * tree grows with that of the parentheses, not the pattern's length */
+static struct ast*
+expression(struct re_context* ctx)
 {
-    int t1, t2, expr;
-    signed char c;
+    struct ast* t, *alt = NULL, **tail = NULL;
 
-    t1 = term();
-    expr = t1;
-    c = lexch();
-    if (c == RE_OR) {
-        expr = t2 = ++state;
-        state++;
-        sm_insert(t2,RE_NODE,expression(),t1);
-        sm_insert(t2-1,RE_NODE,state,state);
-    }
-    else {
-        unlexch();
+    t = term(ctx);
+    while (lexch(ctx) == RE_OR) {
+        if (alt == NULL) {
+            alt = ast_node(&ctx->pool, AST_ALT);
+            alt->child = t;
+            tail = &t->next;
+        }
+        *tail = term(ctx);
+        tail = &(*tail)->next;
     }
-    return expr;
+    unlexch(ctx);
+    return (alt != NULL)?alt:t;
 }
 
-static int
-term(void)
+static struct ast*
+term(struct re_context* ctx)
 {
-    int t;
+    struct ast* t, *seq = NULL, **tail = NULL;
     signed char c;
 
-    t = factor();
-    c = lexch(); unlexch();
-    if (c > '\0' || (c != RE_OR && c != RE_RP && c != '\0')) {
-        int t2 = term();
-        DEBUG("term", t2, t, state);
+    t = factor(ctx);
+    for (;;) {
+        c = lexch(ctx); unlexch(ctx);
+        if (c <= '\0' && (c == RE_OR || c == RE_RP || c == '\0')) break;
+        if (seq == NULL) {
+            seq = ast_node(&ctx->pool, AST_CAT);
+            seq->child = t;
+            tail = &t->next;
+        }
+        *tail = factor(ctx);
+        tail = &(*tail)->next;
     }
-    return t;
+    return (seq != NULL)?seq:t;
 }
 
-static int
-factor(void)
+static struct ast*
+factor(struct re_context* ctx)
 {
-    int t1, t2, fstate;
+    struct ast* t, *cl;
     signed char c;
-    struct sm_entry* st;
 
-    t1 = state;
-    c = lexch();
+    c = lexch(ctx);
     DEBUGV("factor: c: %2d/'%c'\n", c, c);
     if (c == RE_LP) {
-        t2 = expression();
-        c = lexch();
-        if (c != RE_RP) error(RE_ERR_UP);
-        // Original algorithm produces a machine with unreachable
-        // states, e.g. for patterns like "z(a|b)z" where the b
-        // alternate was ignored.
-        // this is an attempt to fix. Use state from t2 (expression)
-        // when t1-1 state is a character or a closure.  Must
-        // also check if closure is for dot (since next1/next2 are swapped)
-        st = sm_state(t1-1);
-        if (st->event > '\0')
-            st->next1 = t2;
-        else if (st->next1 > st->next2)
-            st->next1 = t2;
-        else
-            st->next2 = t2;
+        t = expression(ctx);
+        c = lexch(ctx);
+        if (c != RE_RP) error(ctx, RE_ERR_UP);
     }
-    else if (c > '\0'  || c == RE_DOT || c == RE_BOL || c == RE_EOL) {
-        sm_insert(state, c, state+1, 0);
-        t2 = state;
-        state++;
+    else if (c > '\0') {
+        t = ast_node(&ctx->pool, AST_CHAR);
+        t->c = c;
+    }
+    else if (c == RE_DOT) {
+        t = ast_node(&ctx->pool, AST_DOT);
+    }
+    else if (c == RE_BOL) {
+        t = ast_node(&ctx->pool, AST_BOL);
+    }
+    else if (c == RE_EOL) {
+        t = ast_node(&ctx->pool, AST_EOL);
     }
     else if (c == RE_CC) {
-        sm_insert(state, parse_cc(), state+1, 0);
-        sm_state(state)->cc = strdup(ccbuf);
-        t2 = state;
-        state++;
+        t = ast_node(&ctx->pool, AST_CC);
+        t->cc = parse_cc(ctx);
     }
     else {
-        error(RE_ERR_EX);
+        error(ctx, RE_ERR_EX);
     }
-    c = lexch();
+    c = lexch(ctx);
     if (c != RE_CL) {
-        fstate = t2;
-        unlexch();
+        unlexch(ctx);
+        return t;
     }
-    else {
-        if (sm_state(state-1)->event == RE_DOT)
-            sm_insert(state, RE_NODE, t2, state+1);
+    cl = ast_node(&ctx->pool, AST_STAR);
+    cl->child = t;
+    return cl;
+}
+
+static int emit(struct re_context*, struct ast*, int);
+
+/* n's list of siblings reversed, for emit_seq */
+static struct ast*
+reverse(struct ast* n)
+{
+    struct ast* r = NULL, *next;
+
+    for (; n != NULL; n = next) {
+        next = n->next;
+        n->next = r;
+        r = n;
+    }
+    return r;
+}
+
+/* The states for the sequence of trees from n, emitted from the last
+ * back, as each leads on to the next.  The list is put back after. */
+static int
+emit_seq(struct re_context* ctx, struct ast* n, int next)
+{
+    struct ast* r = reverse(n);
+
+    for (struct ast* x = r; x != NULL; x = x->next) next = emit(ctx, x, next);
+    reverse(r);
+    return next;
+}
+
+/* The states for the alternates from n, a chain of RE_NODEs each
+ * choosing between one alternate and the next node */
+static int
+emit_alt(struct re_context* ctx, struct ast* n, int next)
+{
+    int start = -1, node = -1, prev = -1, first, state;
+
+    for (; n != NULL; n = n->next) {
+        first = emit(ctx, n, next);
+        state = (n->next != NULL)?ctx->state++:first;
+        if (node < 0)
+            start = state;
         else
-            sm_insert(state, RE_NODE, state+1, t2);
-        fstate = state;
-        DEBUG("factor: cl", t1, t2, state);
-        sm_state(t1-1)->next1 = state;
-        state++;
+            insert(ctx, node, RE_NODE, prev, state);
+        node = state;
+        prev = first;
     }
-    return fstate;
+    return start;
 }
 
-struct sm_fsm*
-re_compile(char* re_str, int flags)
+/* Emit the states for the tree n, leading on to state next, returning
+ * the state they start at.  As in Sedgewick's machine, a closure is a
+ * RE_NODE choosing between its body, which leads back to it, and
+ * next. */
+static int
+emit(struct re_context* ctx, struct ast* n, int next)
 {
-    int error_code;
+    int state, cls;
+    signed char event;
 
-    if ((error_code = setjmp(env)) == 0) {
-        if (!sm_init()) {
-            re_error_code = RE_ERR_INIT;
-            return NULL;
+    switch (n->type) {
+        case AST_EMPTY:
+            return next;
+        case AST_CAT:
+            return emit_seq(ctx, n->child, next);
+        case AST_ALT:
+            return emit_alt(ctx, n->child, next);
+        case AST_STAR:
+            state = ctx->state++;
+            insert(ctx, state, RE_NODE, emit(ctx, n->child, state), next);
+            return state;
+        case AST_CC:
+            if ((cls = sm_class_add(ctx->fsm, n->cc)) < 0)
+                error(ctx, RE_ERR_MEM);
+            state = ctx->state++;
+            insert(ctx, state, RE_CC, next, cls);
+            return state;
+        case AST_DOT:
+            event = RE_DOT;
+            break;
+        case AST_BOL:
+            event = RE_BOL;
+            break;
+        case AST_EOL:
+            event = RE_EOL;
+            break;
+        default:
+            event = n->c;
+            break;
+    }
+    state = ctx->state++;
+    insert(ctx, state, event, next, 0);
+    return state;
+}
+
+/* The states consuming a character in the epsilon closure of state,
+ * up to max of them in succ.  Returns how many, or -1 if there are
+ * more than max or the closure includes the accept state or an
+ * anchor.  mark is cleared on return. */
+static int
+successors(struct sm_fsm* fsm, int state, int* succ, int max, char* mark,
+           int* stack)
+{
+    int sp = 0, n = 0, top = 0;
+    struct sm_entry* st;
+    bool fail = false;
+
+    stack[sp++] = state;
+    while (sp > top) {
+        state = stack[top++];
+        if (mark[state]) continue;
+        mark[state] = true;
+        st = fsm->fsm+state;
+        if (state == 0 || st->event == RE_BOL || st->event == RE_EOL)
+            fail = true;
+        else if (st->event == RE_NODE) {
+            stack[sp++] = st->next1;
+            stack[sp++] = st->next2;
+        }
+        else if (n++ < max) {
+            succ[n-1] = state;
+        }
+    }
+    for (int i = 0; i < sp; i++) mark[stack[i]] = false;
+    return (fail || n > max)?-1:n;
+}
+
+/* The single state consuming a character in the epsilon closure of
+ * state, or -1 */
+static int
+single_successor(struct sm_fsm* fsm, int state, char* mark, int* stack)
+{
+    int next;
+
+    return (successors(fsm, state, &next, 1, mark, stack) == 1)?next:-1;
+}
+
+/* Find the literal prefix of every match: the run of plain characters
+ * from the start state with no alternative path around them */
+static bool
+literal_prefix(struct sm_fsm* fsm)
+{
+    int m = fsm->max_state + 1, state, n = 0;
+    char* mark = mem_calloc(m, sizeof(char));
+    int* stack = mem_alloc(2 * m * sizeof(int));
+    char* prefix = mem_alloc(m);
+
+    if (mark == NULL || stack == NULL || prefix == NULL) {
+        mem_free(mark);
+        mem_free(stack);
+        mem_free(prefix);
+        return false;
+    }
+    state = fsm->fsm->next1;
+    // a pattern that loops without accepting is bounded by m
+    while (n < m && (state = single_successor(fsm, state, mark, stack)) > 0
+           && fsm->fsm[state].event > '\0') {
+        prefix[n++] = fsm->fsm[state].event;
+        state = fsm->fsm[state].next1;
+    }
+    mem_free(mark);
+    mem_free(stack);
+    if (n > 0) {
+        DEBUGV("literal prefix: %.*s\n", n, prefix);
+        if ((fsm->prefix = arena_copy(fsm->arena, prefix, n)) == NULL)
+            n = -1;
+        fsm->prefix_len = n;
+    }
+    mem_free(prefix);
+    return n >= 0;
+}
+
+/* For patterns that start with one of a few literals, as (this|that)x*
+ * does, a Teddy search for the set of them */
+static bool
+prefix_set(struct sm_fsm* fsm)
+{
+    int m = fsm->max_state + 1, succ[TEDDY_MAX_LITERALS], nsucc, n, state;
+    char* mark, *lit;
+    int* stack;
+    bool ok = true;
+
+    if (fsm->prefix != NULL) return true;
+    mark = mem_calloc(m, sizeof(char));
+    stack = mem_alloc(2 * m * sizeof(int));
+    lit = mem_alloc(m);
+    if (mark == NULL || stack == NULL || lit == NULL) {
+        mem_free(mark);
+        mem_free(stack);
+        mem_free(lit);
+        return false;
+    }
+    nsucc = successors(fsm, fsm->fsm->next1, succ, TEDDY_MAX_LITERALS, mark,
+                       stack);
+    for (int i = 0; i < nsucc; i++) {
+        if (fsm->fsm[succ[i]].event <= '\0') nsucc = 0;
+    }
+    if (nsucc >= 2 && (fsm->teddy = teddy_init(fsm->arena)) == NULL)
+        ok = false;
+    for (int i = 0; ok && nsucc >= 2 && i < nsucc; i++) {
+        n = 0;
+        state = succ[i];
+        do {
+            lit[n++] = fsm->fsm[state].event;
+            state = single_successor(fsm, fsm->fsm[state].next1, mark,
+                                     stack);
+        } while (n < m && state > 0 && fsm->fsm[state].event > '\0');
+        DEBUGV("prefix set: %.*s\n", n, lit);
+        ok = teddy_add(fsm->teddy, lit, n);
+    }
+    if (fsm->teddy != NULL) teddy_compile(fsm->teddy);
+    mem_free(mark);
+    mem_free(stack);
+    mem_free(lit);
+    return ok;
+}
+
+/* The first occurrence of the literal prefix, or one of the set of
+ * them, of fsm in the len characters from s, or NULL */
+static const char*
+find_prefix(struct sm_fsm* fsm, const char* s, int len)
+{
+    if (fsm->teddy != NULL) return teddy_find(fsm->teddy, s, len);
+    if (fsm->prefix_len == 1) return memchr(s, *fsm->prefix, len);
+    return memmem(s, len, fsm->prefix, fsm->prefix_len);
+}
+
+/* true if the accept state can be reached from the start without
+ * passing through state avoid */
+static bool
+reachable_without(struct sm_fsm* fsm, int avoid, char* mark, int* stack)
+{
+    int sp = 0, top = 0, state;
+    struct sm_entry* st;
+    bool reached = false;
+
+    stack[sp++] = fsm->fsm->next1;
+    while (sp > top) {
+        state = stack[top++];
+        if (state == avoid || mark[state]) continue;
+        mark[state] = true;
+        if (state == 0) {
+            reached = true;
+            continue;
         }
-        lexbuf_init(re_str);
-        state = 1;
-        sm_insert(0,RE_NODE,expression(),0);
-        sm_insert(state,RE_NODE, 0, 0);
+        st = fsm->fsm+state;
+        stack[sp++] = st->next1;
+        if (st->event == RE_NODE) stack[sp++] = st->next2;
     }
-    return (error_code == 0)?sm_get():NULL;
+    for (int i = 0; i < sp; i++) mark[stack[i]] = false;
+    return reached;
 }
 
+/* Find a literal that every match contains, for patterns without a
+ * literal prefix.  A plain character state is required if every path
+ * to the accept state passes through it; a run of them with nothing
+ * between makes a literal.  The run with the least common byte is
+ * chosen, as the one least likely to be found. */
+static bool
+required_literal(struct sm_fsm* fsm)
+{
+    int m = fsm->max_state + 1, state, n, rare, best = 0, best_rare = 0;
+    int best_freq = 256;
+    char* mark, *lit, *best_lit = NULL;
+    int* stack;
+    bool ok = true;
 
+    if (fsm->prefix != NULL || m > REQUIRED_MAX_STATES) return true;
+    mark = mem_calloc(m, sizeof(char));
+    // each state is stacked at most once per edge into it
+    stack = mem_alloc((2 * m + 1) * sizeof(int));
+    lit = mem_alloc(m);
+    if (mark == NULL || stack == NULL || lit == NULL) {
+        mem_free(mark);
+        mem_free(stack);
+        mem_free(lit);
+        return false;
+    }
+    for (int u = 1; u < m; u++) {
+        if (fsm->fsm[u].event <= '\0' ||
+            reachable_without(fsm, u, mark, stack)) continue;
+        n = rare = 0;
+        state = u;
+        do {
+            lit[n] = fsm->fsm[state].event;
+            if (byte_freq[(unsigned char) lit[n]] <
+                byte_freq[(unsigned char) lit[rare]]) rare = n;
+            n++;
+            state = single_successor(fsm, fsm->fsm[state].next1, mark,
+                                     stack);
+        } while (n < m && state > 0 && fsm->fsm[state].event > '\0');
+        if (byte_freq[(unsigned char) lit[rare]] < best_freq ||
+            (byte_freq[(unsigned char) lit[rare]] == best_freq && n > best)) {
+            mem_free(best_lit);
+            if ((best_lit = mem_alloc(n)) == NULL) {
+                ok = false;
+                break;
+            }
+            memcpy(best_lit, lit, n);
+            best = n;
+            best_rare = rare;
+            best_freq = byte_freq[(unsigned char) lit[rare]];
+        }
+    }
+    mem_free(mark);
+    mem_free(stack);
+    mem_free(lit);
+    if (ok && best_lit != NULL) {
+        DEBUGV("required literal: %.*s, scan for: %c\n", best, best_lit,
+               best_lit[best_rare]);
+        if ((fsm->required = arena_copy(fsm->arena, best_lit, best)) == NULL)
+            ok = false;
+        fsm->required_len = best;
+        fsm->rare = best_rare;
+    }
+    mem_free(best_lit);
+    return ok;
+}
+
+/* true if the required literal of fsm occurs in the len characters
+ * from s.  The least common byte is scanned for and the rest checked
+ * around each hit. */
+static bool
+find_required(struct sm_fsm* fsm, const char* s, int len)
+{
+    int k = fsm->rare, n = fsm->required_len;
+    const char* p = s + k, *end = s + len - (n - k);
+
+    while (p < end + 1 && (p = memchr(p, fsm->required[k], end + 1 - p))) {
+        if (memcmp(p - k, fsm->required, n) == 0) return true;
+        p++;
+    }
+    return false;
+}
+
+/* A plain string search for re_str if it has no special characters,
+ * otherwise NULL */
+static struct bmh*
+plain_string(struct sm_fsm* fsm, char* re_str)
+{
+    if (*re_str == '\0' || strpbrk(re_str, "|()*^$.[\\") != NULL)
+        return NULL;
+    return bmh_init(fsm->arena, re_str, strlen(re_str));
+}
+
+/* An Aho-Corasick automaton for re_str if it is an alternation of at
+ * least two plain literals, otherwise NULL.  If there are few enough
+ * of them, they make the prefix set of fsm too. */
+static struct ac*
+literal_alternates(struct sm_fsm* fsm, char* re_str)
+{
+    struct ac* ac;
+    char* word, *p;
+    int n = 0, len;
+    bool ok;
+    struct arena_mark mark = arena_mark(fsm->arena);
+
+    // any special character other than '|' is more than a literal
+    for (p = re_str; *p != '\0'; p++) {
+        if (strchr("()*^$.[\\", *p) != NULL) return NULL;
+        if (*p == '|') n++;
+    }
+    if (n == 0) return NULL;
+    ok = (ac = ac_init(fsm->arena)) != NULL;
+    if (ok && n < TEDDY_MAX_LITERALS) fsm->teddy = teddy_init(fsm->arena);
+    for (word = re_str; ok; word = p + 1) {
+        len = strcspn(word, "|");
+        p = word + len;
+        // an empty alternate matches everywhere, leave it to the NFA
+        ok = len > 0 && ac_add(ac, word, len) &&
+            (fsm->teddy == NULL || teddy_add(fsm->teddy, word, len));
+        if (*p == '\0') break;
+    }
+    // what was allocated goes back to the arena if it can't be used
+    if (!ok || !ac_compile(ac)) {
+        ac_free(ac);
+        fsm->teddy = NULL;
+        arena_release(fsm->arena, mark);
+        return NULL;
+    }
+    if (fsm->teddy != NULL) teddy_compile(fsm->teddy);
+    return ac;
+}
+
+/* The length of the run of characters from state u, which isn't in
+ * the middle of one */
 static int
-matcher(struct sm_fsm* fsm, char* search_str, int start)
-{
-    int n1, n2, ntransitions = 0;
-    int j = start, N = strlen(search_str), state;
-    struct sm_entry* machine, *st;
-    bool bol = false, eol = false;
-
-    machine = fsm->fsm;
-    state = machine->next1;
-    dq_init(2 * fsm->max_state);
-    dq_push_tail(RE_SCAN);
-    DEBUGV("matcher: searching: %s\n", search_str+j);
-    DEBUG("initial", start, N, 0);
-    while (state) {
-        if (ntransitions++ > MAX_TRANSITIONS) error(RE_ERR_STL);
-        st = machine+state;
-        DEBUG("---> state", state, j, 0);
-        if (debug) dq_print();
-        if (state == RE_SCAN) {
-            if (bol && j != 0)
-                return RE_NO_MATCH;
-            else
-                bol = false;
-            j++;
-            dq_push_tail(RE_SCAN);
+run_length(struct sm_fsm* fsm, char* inner, int u)
+{
+    int len = 0;
+
+    if (fsm->fsm[u].event <= '\0' || inner[u]) return 0;
+    for (int v = u; len == 0 || inner[v]; v = fsm->fsm[v].next1) len++;
+    return len;
+}
+
+/* Lower the state machine to bytecode for the matcher.  A run of
+ * characters that nothing else leads into the middle of becomes one
+ * OP_STR, its characters kept after the instructions, and the states
+ * after the first are left unused. */
+static bool
+lower(struct sm_fsm* fsm)
+{
+    int m = fsm->max_state + 1, len, nruns = 0, nstr = 0, v;
+    struct sm_entry* st;
+    struct re_inst* in;
+    int* preds;
+    char* inner, *str;
+
+    preds = mem_calloc(m, sizeof(int));
+    inner = mem_calloc(m, sizeof(char));
+    if (preds == NULL || inner == NULL) {
+        mem_free(preds);
+        mem_free(inner);
+        return false;
+    }
+    preds[fsm->fsm->next1]++;
+    for (int u = 1; u < m; u++) {
+        st = fsm->fsm+u;
+        preds[st->next1]++;
+        if (st->event == RE_NODE && st->next2 != st->next1) preds[st->next2]++;
+    }
+    // a character only reached from the character before it
+    for (int u = 0; u < m; u++) {
+        v = fsm->fsm[u].next1;
+        if (u > 0 && fsm->fsm[u].event > '\0' && v != u &&
+            fsm->fsm[v].event > '\0' && preds[v] == 1)
+            inner[v] = true;
+    }
+    mem_free(preds);
+    for (int u = 1; u < m; u++) {
+        if ((len = run_length(fsm, inner, u)) > 1) nstr += len;
+    }
+    fsm->prog = arena_alloc(fsm->arena, m * sizeof(struct re_inst) + nstr);
+    if (fsm->prog == NULL) {
+        mem_free(inner);
+        return false;
+    }
+    str = (char*) (fsm->prog + m);
+    fsm->max_str = 0;
+    for (int u = 0; u < m; u++) {
+        st = fsm->fsm+u;
+        in = fsm->prog+u;
+        in->x = st->next1;
+        in->y = st->next2;
+        in->cls = NULL;
+        if (u == 0) {
+            // state 0 both starts the machine and accepts
+            in->op = OP_MATCH;
+            continue;
         }
-        else if (st->event == search_str[j] || st->event == RE_DOT) {
-            // BOL flag in next2 for char
-            if (st->next2 == RE_BOL && j != 0) return RE_NO_MATCH;
-            // for reasons unclear, closures within closures (e.g
-            // (aa*)*) causes duplicate pending states to be enqueued.
-            // This test stops that happening
-            if (dq_peek_tail() != st->next1) dq_push_tail(st->next1);
+        switch (st->event) {
+            case RE_NODE:
+                in->op = (st->next1 == st->next2)?OP_JMP:OP_SPLIT;
+                break;
+            case RE_BOL:
+                in->op = OP_BOL;
+                break;
+            case RE_EOL:
+                in->op = OP_EOL;
+                break;
+            case RE_DOT:
+                in->op = OP_ANY;
+                break;
+            case RE_CC:
+                in->op = OP_CLASS;
+                in->cls = fsm->classes[st->next2];
+                break;
+            default:
+                in->op = OP_CHAR;
+                in->c = st->event;
+                if (run_length(fsm, inner, u) < 2) break;
+                for (len = 0, v = u; len == 0 || inner[v]; v = fsm->fsm[v].next1)
+                    str[len++] = fsm->fsm[v].event;
+                in->op = OP_STR;
+                in->x = v;
+                in->y = len;
+                in->str = str;
+                str += len;
+                nruns++;
+                if (len > fsm->max_str) fsm->max_str = len;
+                break;
         }
-        else if (st->event == RE_NODE) {
-            n1 = st->next1;
-            n2 = st->next2;
-            dq_push_head(n1);
-            if (n1 != n2) dq_push_head(n2);
+    }
+    mem_free(inner);
+    DEBUGV("lower: %d literal runs, longest %d\n", nruns, fsm->max_str);
+    return true;
+}
+
+struct sm_fsm*
+re_compile(char* re_str, int flags)
+{
+    int error_code;
+    struct re_context ctx;
+    struct sm_fsm* fsm;
+    struct ast* root;
+
+    if ((ctx.fsm = sm_init()) == NULL) {
+        re_error_code = RE_ERR_INIT;
+        return NULL;
+    }
+    ctx.fsm->serial = atomic_fetch_add(&serial, 1) + 1;
+    /* The NFA and DFA remain selectable for plain strings and
+     * alternates of them.  Otherwise, with the string search or
+     * automaton, the state machine is no more than the accept state;
+     * it isn't used. */
+    if (!(flags & (RE_NFA|RE_DFA|RE_BP|RE_JIT)) &&
+        ((ctx.fsm->bmh = plain_string(ctx.fsm, re_str)) != NULL ||
+         (ctx.fsm->ac = literal_alternates(ctx.fsm, re_str)) != NULL)) {
+        if (!sm_insert(ctx.fsm, 0, RE_NODE, 0, 0) || !sm_trim(ctx.fsm)) {
+            sm_free(ctx.fsm);
+            re_error_code = RE_ERR_MEM;
+            return NULL;
         }
-        else if (st->event == RE_BOL) {
-            if (st->next1 == state+1)
-                sm_state(state+1)->next2 = RE_BOL; // applies this expr
-            else
-                bol = true; // applies to all alternates e.g. ^(a|b|c)
-            dq_push_head(st->next1);
+        return ctx.fsm;
+    }
+    ctx.pool.all = NULL;
+    ctx.pool.tables = NULL;
+    ctx.pool.env = &ctx.env;
+    if ((error_code = setjmp(ctx.env)) == 0) {
+        lexbuf_init(&ctx, re_str);
+        root = expression(&ctx);
+        DEBUGV("ast: %d nodes\n", ast_count(root));
+        if (flags & RE_OPT) {
+            root = ast_simplify(&ctx.pool, root);
+            DEBUGV("ast: %d nodes simplified\n", ast_count(root));
         }
-        else if (st->event == RE_EOL) {
-            eol = true;
-            dq_push_head(st->next1);
+        if (debug) {
+            ast_print(stderr, root);
+            fputc('\n', stderr);
         }
-        else if (st->event == RE_CC) {
-            if (search_str[j] != '\0' && strchr(st->cc,search_str[j])) {
-                if (st->next2 == RE_BOL && j != 0) return RE_NO_MATCH;
-                if (dq_peek_tail() != st->next1) dq_push_tail(st->next1);
-            }
+        ctx.state = 1;
+        insert(&ctx, 0, RE_NODE, emit(&ctx, root, 0), 0);
+    }
+    ast_free(&ctx.pool);
+    if (error_code != 0) {
+        sm_free(ctx.fsm);
+        return NULL;
+    }
+    fsm = ctx.fsm;
+    if (((flags & RE_OPT) && opt_run(fsm) < 0) || !sm_trim(fsm)) {
+        sm_free(fsm);
+        re_error_code = RE_ERR_MEM;
+        return NULL;
+    }
+    for (int u = 1; u <= fsm->max_state; u++)
+        fsm->bol |= fsm->fsm[u].event == RE_BOL;
+    if (!lower(fsm) || !literal_prefix(fsm) || !prefix_set(fsm) ||
+        !required_literal(fsm)) {
+        sm_free(fsm);
+        re_error_code = RE_ERR_MEM;
+        return NULL;
+    }
+    if ((flags & RE_BP) && !(flags & (RE_NFA|RE_DFA|RE_JIT)))
+        fsm->gk = gk_init(fsm);
+    // too many positions for RE_BP and the DFA is used
+    if (!(flags & RE_NFA) && fsm->gk == NULL) {
+        // the matcher is used if either DFA can't be had
+        fsm->fwd = dfa_init(fsm, 0);
+        fsm->rev = dfa_init(fsm, DFA_REVERSE|DFA_UNANCHORED);
+        // a DFA too large to compile is left lazy, and one that
+        // can't have native code is scanned by table
+        if ((flags & (RE_DFA|RE_JIT)) && fsm->fwd && fsm->rev) {
+            if (dfa_compile(fsm->fwd) && (flags & RE_JIT))
+                dfa_jit(fsm->fwd);
+            if (dfa_compile(fsm->rev) && (flags & RE_JIT))
+                dfa_jit(fsm->rev);
         }
-        else if (st->event == RE_NCC) {
-            if (!strchr(st->cc,search_str[j])) {
-                if (st->next2 == RE_BOL && j != 0) return RE_NO_MATCH;
-                if (dq_peek_tail() != st->next1) dq_push_tail(st->next1);
+    }
+    return fsm;
+}
+
+
+/* States entered at a step, after Briggs and Torczon: dense holds the
+ * members and sparse the index of each in dense, so that adding,
+ * testing and emptying take constant time, and emptying the set
+ * leaves the arrays alone. */
+struct state_set {
+    int* dense;
+    int* sparse;
+    int n;
+};
+
+/* Threads at a step, in order of start */
+struct threads {
+    int* pc;
+    int* start;
+    int n;
+};
+
+/* Matcher state for a single pass over the search string */
+struct thread_list {
+    struct re_inst* prog;
+    const char* search_str;
+    int len;
+    struct state_set entered;   // at the step being added to
+    struct threads* cur;        // this step
+    struct threads* next;       // and the next
+    int* stack;                 // epsilon closure work list
+    int* due;                   // threads past a literal, by step % nsteps
+    int* resume;                // state to resume each at
+    int* rstart;                // its start offset
+    int* rnext;                 // next in the list, or -1
+    int nsteps;
+    int pending;                // threads past a literal
+    int free;                   // list of unused entries
+    int unused;                 // entries never used
+    int j;                      // step reached, if suspended
+    struct re_matched matched;
+    bool found;
+};
+
+/* Match time state, owned by the caller so that a compiled regex is
+ * never written to and may be shared between threads.  A scratch may
+ * be reused for any number of matches against the regex it was made
+ * for, but by one thread at a time. */
+struct re_scratch {
+    struct sm_fsm* fsm;
+    unsigned long serial;       // of fsm
+    int* work;                  // matcher work areas, by state
+    struct threads lists[2];    // in work
+    struct dfa_cache* fwd;      // DFA states built so far
+    struct dfa_cache* rev;
+    long budget;                // matcher steps a search may take, or 0
+    bool suspended;             // a search stopped by its budget,
+    const char* s;              //   what it was passed
+    int len;
+    int from;
+    struct thread_list tl;      //   and where the matcher had got to
+};
+
+/* Threaded dispatch: each instruction's code jumps straight to the
+ * code for the next, so that each has its own branch to predict.
+ * Without computed goto a switch does the same job. */
+#ifdef __GNUC__
+#define DISPATCH(table, op) goto *table[op]
+#else
+#define DISPATCH(table, op)                                     \
+    switch (op) {                                               \
+        case OP_CHAR: goto op_char;                             \
+        case OP_STR: goto op_str;                               \
+        case OP_CLASS: goto op_class;                           \
+        case OP_ANY: goto op_any;                               \
+        case OP_SPLIT: goto op_split;                           \
+        case OP_JMP: goto op_jmp;                               \
+        case OP_BOL: goto op_bol;                               \
+        case OP_EOL: goto op_eol;                               \
+        default: goto op_match;                                 \
+    }
+#endif
+
+static inline bool
+set_has(struct state_set* set, int x)
+{
+    unsigned i = set->sparse[x];
+
+    return i < (unsigned) set->n && set->dense[i] == x;
+}
+
+static inline void
+set_add(struct state_set* set, int x)
+{
+    set->sparse[x] = set->n;
+    set->dense[set->n++] = x;
+}
+
+/* Add the thread at pc to the list for step j, following epsilon
+ * transitions.  Only instructions that consume a character are
+ * listed.  Threads are added in order of start, so the first to reach
+ * a state at a step has the earliest start, and no state is entered
+ * twice in a step. */
+static void
+addthread(struct thread_list* tl, int pc, int start, int j)
+{
+#ifdef __GNUC__
+    static const void* ops[] = {
+        [OP_CHAR] = &&op_char, [OP_STR] = &&op_str, [OP_CLASS] = &&op_class,
+        [OP_ANY] = &&op_any, [OP_SPLIT] = &&op_split, [OP_JMP] = &&op_jmp,
+        [OP_BOL] = &&op_bol, [OP_EOL] = &&op_eol, [OP_MATCH] = &&op_match
+    };
+#endif
+    int sp = 0;
+    int* stack = tl->stack;
+    struct state_set* entered = &tl->entered;
+    struct threads* next = tl->next;
+    struct re_inst* in;
+    bool at_end = j == tl->len;
+
+// pop the next instruction not yet entered at this step and run it
+#define NEXT                                                    \
+    do {                                                        \
+        if (sp == 0) return;                                    \
+        pc = stack[--sp];                                       \
+    } while (set_has(entered, pc));                             \
+    set_add(entered, pc);                                       \
+    in = tl->prog + pc;                                         \
+    DISPATCH(ops, in->op)
+
+    if (tl->found && start > tl->matched.start) return;
+    stack[sp++] = pc;
+    NEXT;
+op_split:
+    stack[sp++] = in->y;
+    stack[sp++] = in->x;
+    NEXT;
+op_jmp:
+    stack[sp++] = in->x;
+    NEXT;
+op_bol:
+    if (j == 0) stack[sp++] = in->x;
+    NEXT;
+op_eol:
+    if (at_end) stack[sp++] = in->x;
+    NEXT;
+op_match:
+    if (!tl->found || start < tl->matched.start || j > tl->matched.end) {
+        tl->matched.start = start;
+        tl->matched.end = j;
+        tl->found = true;
+    }
+    NEXT;
+op_char:
+op_str:
+op_class:
+op_any:
+    if (!at_end) {
+        next->pc[next->n] = pc;
+        next->start[next->n++] = start;
+    }
+    NEXT;
+#undef NEXT
+}
+
+/* Hold the thread for state pc until step j, past a literal.  The
+ * threads due at a step are kept in order of start. */
+static void
+defer(struct thread_list* tl, int pc, int start, int j)
+{
+    int e = (tl->free >= 0)?tl->free:tl->unused++;
+    int* p = &tl->due[j % tl->nsteps];
+
+    if (e == tl->free) tl->free = tl->rnext[e];
+    tl->resume[e] = pc;
+    tl->rstart[e] = start;
+    while (*p >= 0 && tl->rstart[*p] <= start) p = &tl->rnext[*p];
+    tl->rnext[e] = *p;
+    *p = e;
+    tl->pending++;
+}
+
+/* Add the threads held until step j that started before start */
+static void
+resume(struct thread_list* tl, int j, int start)
+{
+    int* due = &tl->due[j % tl->nsteps], e;
+
+    while ((e = *due) >= 0 && tl->rstart[e] < start) {
+        *due = tl->rnext[e];
+        addthread(tl, tl->resume[e], tl->rstart[e], j);
+        tl->rnext[e] = tl->free;
+        tl->free = e;
+        tl->pending--;
+    }
+}
+
+/* Single pass matcher.  The threads at each step are listed in order
+ * of the offset they started from, the start state being entered
+ * after the existing threads at each step (an implicit leading .*)
+ * rather than restarting for every offset.  Since the first thread to
+ * reach a state has the earliest start, a state is entered at most
+ * once per step, which bounds the work to O(n*m).  When no thread is
+ * live the matcher skips ahead to the next occurrence of the literal
+ * prefix, if there is one.  A thread at an OP_STR compares the whole
+ * literal at once and is held until the step after it, rather than
+ * stepping through it a character at a time, then taken in with the
+ * threads of that step in order of start.  The result is the
+ * leftmost-longest match.  With a budget, the matcher stops between
+ * steps once it has spent it, keeping its threads in the scratch, and
+ * carries on from there when next called. */
+static bool
+matcher(struct re_scratch* rs, const char* search_str, int len, int from,
+        struct re_matched* matched)
+{
+#ifdef __GNUC__
+    static const void* ops[] = {
+        [OP_CHAR] = &&op_char, [OP_STR] = &&op_str, [OP_CLASS] = &&op_class,
+        [OP_ANY] = &&op_any, [OP_SPLIT] = &&op_split, [OP_JMP] = &&op_jmp,
+        [OP_BOL] = &&op_bol, [OP_EOL] = &&op_eol, [OP_MATCH] = &&op_match
+    };
+#endif
+    int state, start, j;
+    long left = rs->budget;
+    const char* next;
+    unsigned char c;
+    struct thread_list tl = rs->tl;
+    struct threads* t;
+    struct re_inst* in;
+
+    if (rs->suspended) {
+        j = tl.j;
+        search_str = tl.search_str;
+        len = tl.len;
+        rs->suspended = false;
+        DEBUGV("matcher: resuming at %d\n", j);
+    }
+    else {
+        j = from;
+        tl.pending = tl.unused = 0;
+        tl.free = -1;
+        for (int i = 0; i < tl.nsteps; i++) tl.due[i] = -1;
+        tl.search_str = search_str;
+        tl.len = len;
+        tl.found = false;
+        DEBUGV("matcher: searching: %.*s\n", len - from, search_str + from);
+        tl.entered.n = tl.next->n = 0;
+        addthread(&tl, tl.prog->x, j, j);
+        t = tl.cur; tl.cur = tl.next; tl.next = t;
+        tl.entered.n = tl.next->n = 0;
+    }
+    while (j < len) {
+        // a step costs one and one more for each thread taking it, and
+        // at least one step is taken each call
+        if (rs->budget > 0) {
+            if (left <= tl.cur->n && left < rs->budget) {
+                tl.j = j;
+                rs->tl = tl;
+                rs->suspended = true;
+                re_error_code = RE_ERR_BUDGET;
+                DEBUGV("matcher: suspended at %d\n", j);
+                return false;
             }
+            left -= tl.cur->n + 1;
+        }
+        c = search_str[j];
+        for (int i = 0; i < tl.cur->n; i++) {
+            state = tl.cur->pc[i];
+            start = tl.cur->start[i];
+            // threads starting after a match already found can't improve
+            // it, nor can those after them
+            if (tl.found && start > tl.matched.start) break;
+            // threads held past a literal that started earlier go first
+            if (tl.pending > 0) resume(&tl, j+1, start);
+            in = tl.prog + state;
+            DISPATCH(ops, in->op);
+        op_char:
+            if (c != in->c) continue;
+            goto op_any;
+        op_class:
+            if (!SM_CLASS_HAS(in->cls->bits, c)) continue;
+        op_any:
+            addthread(&tl, in->x, start, j+1);
+            continue;
+        op_str:
+            if (c != in->c || in->y > len - j ||
+                memcmp(search_str + j + 1, in->str + 1, in->y - 1) != 0)
+                continue;
+            defer(&tl, in->x, start, j + in->y);
+            continue;
+            // only instructions that match are listed
+        op_split:
+        op_jmp:
+        op_bol:
+        op_eol:
+        op_match:
+            continue;
+        }
+        j++;
+        if (tl.pending > 0) resume(&tl, j, INT_MAX);
+        if (!tl.found && tl.next->n == 0 && tl.pending == 0 &&
+            (rs->fsm->prefix != NULL || rs->fsm->teddy != NULL)) {
+            next = find_prefix(rs->fsm, search_str+j, len-j);
+            if (next == NULL) break;
+            j = next - search_str;
+            tl.entered.n = 0;
         }
+        // once matched, a later start can't be leftmost
+        if (!tl.found) addthread(&tl, tl.prog->x, j, j);
+        if (tl.next->n == 0 && tl.pending == 0) {
+            // nothing to consume from the start before the end,
+            // as for '$', leaves only the end to try
+            if (tl.found || j == len) break;
+            j = len - 1;
+        }
+        t = tl.cur; tl.cur = tl.next; tl.next = t;
+        tl.entered.n = tl.next->n = 0;
+    }
+    DEBUG("matcher return", tl.found, tl.matched.start, tl.matched.end);
+    if (tl.found) *matched = tl.matched;
+    return tl.found;
+}
+
+struct re_scratch*
+re_scratch_init(struct sm_fsm* fsm)
+{
+    struct re_scratch* rs;
+    struct thread_list* tl;
+    int m = fsm->max_state + 1;
+
+    if ((rs = mem_calloc(1, sizeof(struct re_scratch))) == NULL) {
+        re_error_code = RE_ERR_MEM;
+        return NULL;
+    }
+    rs->fsm = fsm;
+    rs->serial = fsm->serial;
+    // a state may be stacked once per transition into it.  The sets
+    // are never cleared, so are zeroed only for the tools that check
+    // for reading memory not yet written.
+    rs->work = mem_calloc(12 * m + 2, sizeof(int));
+    if (rs->work == NULL) {
+        re_scratch_free(rs);
+        re_error_code = RE_ERR_MEM;
+        return NULL;
+    }
+    tl = &rs->tl;
+    tl->entered.dense = rs->work;
+    tl->entered.sparse = tl->entered.dense + m;
+    rs->lists[0].pc = tl->entered.sparse + m;
+    rs->lists[0].start = rs->lists[0].pc + m;
+    rs->lists[1].pc = rs->lists[0].start + m;
+    rs->lists[1].start = rs->lists[1].pc + m;
+    tl->cur = &rs->lists[0];
+    tl->next = &rs->lists[1];
+    tl->stack = rs->lists[1].start + m;
+    // a literal run has a thread held for each of its characters
+    tl->resume = tl->stack + 2 * m + 1;
+    tl->rstart = tl->resume + m;
+    tl->rnext = tl->rstart + m;
+    tl->due = tl->rnext + m;
+    tl->nsteps = fsm->max_str + 1;
+    tl->prog = fsm->prog;
+    // a lazy DFA without a cache leaves matching to the matcher
+    if (fsm->fwd && fsm->rev) {
+        rs->fwd = dfa_cache_init(fsm->fwd);
+        rs->rev = dfa_cache_init(fsm->rev);
+    }
+    return rs;
+}
+
+/* Limit each search with rs to about steps steps of the matcher, one
+ * for each character and thread taking it, or lift the limit if steps
+ * is 0.  A search that spends its budget fails with RE_ERR_BUDGET, and
+ * carries on where it stopped if called again with the same string. */
+void
+re_scratch_budget(struct re_scratch* rs, long steps)
+{
+    rs->budget = (steps > 0)?steps:0;
+    rs->suspended = false;
+}
+
+void
+re_scratch_free(struct re_scratch* rs)
+{
+    if (rs == NULL) return;
+    mem_free(rs->work);
+    dfa_cache_free(rs->fwd);
+    dfa_cache_free(rs->rev);
+    mem_free(rs);
+}
 
-        DEBUG("matcher end", dq_empty(), j, N);
-        if (debug) dq_print();
-        if (dq_empty() || j == N+1) return RE_NO_MATCH;
-        state = dq_pop_head();
-        // attempt to fix a defect in the matcher when
-        // closure is last pattern
-        if (state == 0 && dq_peek_tail() != RE_SCAN) {
-           state = dq_pop_head();
+/* Search the len characters from s, which the caller has already
+ * advanced to the first possible start of a match */
+static bool
+search(struct sm_fsm* fsm, struct re_scratch* rs, const char* s, int len,
+       struct re_matched* matched)
+{
+    // only the matcher can stop part way and carry on
+    if (rs->budget > 0) return matcher(rs, s, len, 0, matched);
+    if (fsm->gk != NULL)
+        return gk_match(fsm->gk, s, len, &matched->start, &matched->end);
+    if (fsm->fwd && fsm->rev) {
+        // leftmost start from the end, then longest end from there
+        matched->start = dfa_scan(fsm->rev, rs->rev, s, len, len);
+        if (matched->start == DFA_NO_MATCH) return false;
+        if (matched->start != DFA_FAILED) {
+            matched->end = dfa_scan(fsm->fwd, rs->fwd, s, len,
+                                    matched->start);
+            if (matched->end >= 0) return true;
+        }
+    }
+    return matcher(rs, s, len, 0, matched);
+}
+
+/* Search the len bytes at s for the leftmost-longest match starting
+ * at or after from, using the scratch rs made for fsm and leaving the
+ * result, as offsets from s, in matched.  s needn't be terminated and
+ * may hold any bytes.  A '^' matches only at s itself, whatever from
+ * is. */
+bool
+re_search(struct sm_fsm* fsm, struct re_scratch* rs, const char* s,
+          int len, int from, struct re_matched* matched)
+{
+    int skip = from;
+    const char* first;
+    bool found;
+
+    re_error_code = 0;
+    if (from < 0 || from > len) return false;
+    // a search stopped by its budget is carried on if called again
+    if (rs->suspended && (s != rs->s || len != rs->len || from != rs->from))
+        rs->suspended = false;
+    rs->s = s;
+    rs->len = len;
+    rs->from = from;
+    if (rs->suspended) {
+        skip = rs->tl.search_str - s;
+        found = matcher(rs, NULL, 0, 0, matched);
+    }
+    /* The other matchers take the search to start at the start of the
+     * string, so only the matcher, with the whole string, can tell
+     * that a '^' can't match at from. */
+    else if (from > 0 && fsm->bol) {
+        skip = 0;
+        found = matcher(rs, s, len, from, matched);
+    }
+    else if (fsm->bmh != NULL)
+        found = bmh_find(fsm->bmh, s+skip, len-skip, &matched->start,
+                         &matched->end);
+    /* No match can start before the prefix does.  Any anchor in the
+     * pattern follows the prefix, so starting the search part way
+     * into the string can't satisfy a '^' that wouldn't be. */
+    else {
+        if (fsm->prefix != NULL || fsm->teddy != NULL) {
+            if ((first = find_prefix(fsm, s+skip, len-skip)) == NULL)
+                return false;
+            skip = first - s;
         }
-        DEBUG("final", state, 0, 0);
+        else if (fsm->required != NULL &&
+                 !find_required(fsm, s+skip, len-skip))
+            return false;
+        if (fsm->ac != NULL)
+            found = ac_scan(fsm->ac, s+skip, len-skip, &matched->start,
+                            &matched->end);
+        else
+            found = search(fsm, rs, s+skip, len-skip, matched);
+    }
+    if (!found) return false;
+    matched->start += skip;
+    matched->end += skip;
+    return true;
+}
+
+/* Reentrant form of re_match, using the scratch rs made for fsm and
+ * leaving the result in matched */
+bool
+re_match_r(struct sm_fsm* fsm, struct re_scratch* rs, char* search_str,
+           struct re_matched* matched)
+{
+    return re_search(fsm, rs, search_str, strlen(search_str), 0, matched);
+}
+
+/* The scratches re_match keeps for the regexes this thread matched
+ * last, the most recent first.  They are freed when the thread exits. */
+static _Thread_local struct re_scratch* match_pool[MATCH_POOL];
+static pthread_key_t pool_key;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+static void
+pool_free(void* pool)
+{
+    struct re_scratch** rs = pool;
+
+    for (int i = 0; i < MATCH_POOL; i++) {
+        re_scratch_free(rs[i]);
+        rs[i] = NULL;
     }
-    DEBUG("matcher return", j, bol, eol);
-    if (eol && j != N) return RE_NO_MATCH;
-    return j;
+}
+
+static void
+pool_init(void)
+{
+    pthread_key_create(&pool_key, pool_free);
+}
+
+static bool
+scratch_for(struct re_scratch* rs, struct sm_fsm* fsm)
+{
+    return rs != NULL && rs->fsm == fsm && rs->serial == fsm->serial;
 }
 
 struct re_matched*
 re_match(struct sm_fsm* fsm, char* search_str)
 {
-    int end;
-    static struct re_matched matched;
+    static _Thread_local struct re_matched matched;
+    struct re_scratch* rs;
+    int i;
 
-    for (int i = 0; search_str[i] != '\0'; i++) {
-        end = matcher(fsm,search_str,i);
-        if ( end != RE_NO_MATCH) {
-            matched.start = i;
-            matched.end = end;
-            return &matched;
+    // the scratch kept for fsm, or the slot of the one used least
+    // recently, which is replaced
+    for (i = 0; i < MATCH_POOL - 1; i++) {
+        if (match_pool[i] == NULL || scratch_for(match_pool[i], fsm))
+            break;
+    }
+    if (!scratch_for(rs = match_pool[i], fsm)) {
+        re_scratch_free(rs);
+        match_pool[i] = NULL;
+        if ((rs = re_scratch_init(fsm)) == NULL) return NULL;
+        pthread_once(&pool_once, pool_init);
+        pthread_setspecific(pool_key, match_pool);
+    }
+    memmove(match_pool + 1, match_pool, i * sizeof(struct re_scratch*));
+    match_pool[0] = rs;
+    return re_match_r(fsm, rs, search_str, &matched)?&matched:NULL;
+}
+
+/* Free the compiled regex fsm.  No thread may be matching with it,
+ * and the scratches made for it must be freed first, other than those
+ * re_match keeps, which are freed here if this thread's. */
+void
+re_free(struct sm_fsm* fsm)
+{
+    int n = 0;
+
+    if (fsm == NULL) return;
+    for (int i = 0; i < MATCH_POOL; i++) {
+        if (match_pool[i] != NULL && match_pool[i]->fsm == fsm)
+            re_scratch_free(match_pool[i]);
+        else
+            match_pool[n++] = match_pool[i];
+    }
+    while (n < MATCH_POOL) match_pool[n++] = NULL;
+    dfa_free(fsm->fwd);
+    dfa_free(fsm->rev);
+    sm_free(fsm);
+}
+
+/* The parts of a compiled regex re_footprint reports, those in its
+ * arena first */
+enum {
+    FP_STATES, FP_BYTECODE, FP_LITERALS, FP_SEARCH, FP_BP, FP_DFA,
+    FP_UNUSED,                  // the arena past the parts before
+    FP_CODE,                    // native code, outside the arena
+    FP_PARTS
+};
+
+/* Bytes of memory a compiled regex holds: its arena and any native
+ * code, but not the classes it shares with other regexes nor the
+ * scratch it is matched with.  If fp isn't NULL, what they are taken
+ * by is written to it. */
+size_t
+re_footprint(struct sm_fsm* fsm, FILE* fp)
+{
+    int m = fsm->max_state + 1, nblocks;
+    size_t prog = 0, arena = arena_size(fsm->arena, &nblocks), used = 0;
+    size_t code = dfa_code_size(fsm->fwd) + dfa_code_size(fsm->rev);
+
+    if (fsm->prog != NULL) {
+        prog = m * sizeof(struct re_inst);
+        for (int u = 0; u < m; u++) {
+            if (fsm->prog[u].op == OP_STR) prog += fsm->prog[u].y;
         }
     }
-    return NULL;
+    size_t size[FP_PARTS] = {
+        [FP_STATES] = sm_size(fsm),
+        [FP_BYTECODE] = prog,
+        [FP_LITERALS] = fsm->prefix_len + fsm->required_len,
+        [FP_SEARCH] = ac_size(fsm->ac) + teddy_size(fsm->teddy) +
+            bmh_size(fsm->bmh),
+        [FP_BP] = gk_size(fsm->gk),
+        [FP_DFA] = dfa_size(fsm->fwd) + dfa_size(fsm->rev),
+        [FP_CODE] = code
+    };
+    const char* what[FP_PARTS] = {
+        "states", "bytecode", "literals", "literal search", "bit-parallel",
+        "dfa", "unused", "native code"
+    };
+
+    // what the arena holds past the parts: alignment, block headers and
+    // room not yet used
+    for (int i = 0; i < FP_UNUSED; i++) used += size[i];
+    size[FP_UNUSED] = (arena > used)?arena - used:0;
+    for (int i = 0; fp != NULL && i < FP_PARTS; i++) {
+        if (size[i] > 0) fprintf(fp, "%-16s%8zu\n", what[i], size[i]);
+    }
+    if (fp != NULL) {
+        fprintf(fp, "%d states, %d classes, %zu bytes in %d blocks\n", m,
+                fsm->nclasses, arena + code, nblocks);
+    }
+    return arena + code;
+}
+
+/* Write a standalone C matcher for fsm, compiled from re_str with
+ * RE_DFA, to fp.  The function defined is
+ *
+ *      bool RE_GENERATED_NAME(const char* s, int* start, int* end)
+ *
+ * and finds the leftmost-longest match in s, as re_match does. */
+bool
+re_generate(struct sm_fsm* fsm, char* re_str, FILE* fp)
+{
+    re_error_code = 0;
+    if (fsm->fwd == NULL || fsm->rev == NULL) {
+        re_error_code = RE_ERR_GEN;
+        return false;
+    }
+    fprintf(fp, "/* Generated by ret -g from the regular expression\n *\n"
+            " *      ");
+    for (char* p = re_str; *p != '\0'; p++) {
+        fputc(*p, fp);
+        // keep the comment open
+        if (*p == '*' && p[1] == '/') fputc(' ', fp);
+    }
+    fprintf(fp, "\n */\n\n#include <stdbool.h>\n#include <string.h>\n\n");
+    fprintf(fp, "#ifndef RE_GENERATED_NAME\n"
+            "#define RE_GENERATED_NAME re_generated\n#endif\n\n");
+    if (!dfa_generate(fsm->rev, fp, "rev_scan")) {
+        re_error_code = RE_ERR_GEN;
+        return false;
+    }
+    fprintf(fp, "\n");
+    if (!dfa_generate(fsm->fwd, fp, "fwd_scan")) {
+        re_error_code = RE_ERR_GEN;
+        return false;
+    }
+    fprintf(fp, "\n/* The leftmost-longest match in s */\nbool\n"
+            "RE_GENERATED_NAME(const char* s, int* start, int* end)\n{\n"
+            "    int len = strlen(s);\n\n"
+            "    // leftmost start from the end, then longest end from there\n"
+            "    if ((*start = rev_scan(s, len, len)) < 0) return false;\n"
+            "    *end = fwd_scan(s, len, *start);\n"
+            "    return true;\n}\n");
+    return true;
 }
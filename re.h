@@ -1,8 +1,14 @@
 #ifndef RE_H
 #define RE_H
 
+#include <stdio.h>
+
 #include "sm.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* error codes */
 enum {
     RE_ERR_UP = 1, // unbalanced parentheses
@@ -10,7 +16,13 @@ enum {
     RE_ERR_STL,    // state transition limit exceeded
     RE_ERR_INIT,   // state machine initialisation failed
     RE_ERR_MEM,    // memory allocation failed in state machine
-    RE_OPT = 1     // optimise state machine
+    RE_ERR_GEN,    // DFA too large to generate code for
+    RE_ERR_BUDGET, // search budget spent, call again to carry on
+    RE_OPT = 1,    // optimise state machine
+    RE_NFA = 2,    // match by NFA simulation only, no DFA
+    RE_DFA = 4,    // compile the whole DFA ahead of matching
+    RE_BP = 8,     // bit-parallel Glushkov simulation, if small enough
+    RE_JIT = 16    // native code for the compiled DFA, where supported
 };
 
 struct re_matched {
@@ -18,11 +30,41 @@ struct re_matched {
     int end;
 };
 
+/* Where the library's memory comes from, as malloc, realloc and free
+ * would give it, each passed ctx */
+struct re_allocator {
+    void* (*alloc)(void* ctx, size_t size);
+    void* (*resize)(void* ctx, void* p, size_t size);
+    void (*release)(void* ctx, void* p);
+    void* ctx;
+};
+
 struct sm_fsm*  re_compile(char*, int);
 char* re_error_msg(void);
 struct re_matched* re_match(struct sm_fsm*, char*);
+struct re_scratch* re_scratch_init(struct sm_fsm*);
+void re_scratch_free(struct re_scratch*);
+void re_scratch_budget(struct re_scratch*, long);
+bool re_match_r(struct sm_fsm*, struct re_scratch*, char*,
+                struct re_matched*);
+bool re_search(struct sm_fsm*, struct re_scratch*, const char*, int, int,
+               struct re_matched*);
+void re_free(struct sm_fsm*);
+bool re_generate(struct sm_fsm*, char*, FILE*);
+size_t re_footprint(struct sm_fsm*, FILE*);
+void re_set_allocator(const struct re_allocator*);
 
 extern bool debug;
-extern int re_error_code;
+
+/* Print to stderr, as fprintf does, if debug is set */
+#define DEBUGV(...) \
+    do { if (debug) fprintf(stderr, __VA_ARGS__); } while (0)
+
+#ifdef __cplusplus
+extern thread_local int re_error_code;
+}
+#else
+extern _Thread_local int re_error_code;
+#endif
 
 #endif
@@ -0,0 +1,189 @@
+/* C++ interface
+ *
+ * re::Regex owns a compiled regex and the scratch it is matched with,
+ * and frees both when it goes.  It can be moved but not copied.
+ * Strings are passed as std::string_view and needn't be terminated;
+ * matches are std::string_views into the string searched, so matching
+ * copies nothing and, once the scratch's work areas have grown to the
+ * pattern, allocates nothing.
+ *
+ *      re::Regex r("th(ei|ie)r");
+ *
+ *      for (std::string_view m : r.matches(text))
+ *          ...
+ *
+ * Like a scratch, a Regex is used by one thread at a time: matching
+ * writes to the scratch, so search and matches aren't const, and a
+ * Regex shared between threads must be locked even to match.
+ */
+
+#ifndef RE_HPP
+#define RE_HPP
+
+#include <climits>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "re.h"
+
+namespace re {
+
+class error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class Regex {
+public:
+    class iterator;
+    class range;
+
+    /* Compile pattern with the re_compile flags, throwing re::error
+     * if it can't be */
+    explicit Regex(std::string_view pattern, int flags = RE_OPT)
+    {
+        std::string re_str(pattern);
+
+        if ((fsm_ = re_compile(re_str.data(), flags)) == nullptr)
+            throw error(re_error_msg());
+        if ((scratch_ = re_scratch_init(fsm_)) == nullptr) {
+            re_free(fsm_);
+            throw error(re_error_msg());
+        }
+    }
+
+    Regex(Regex&& other) noexcept
+        : fsm_(std::exchange(other.fsm_, nullptr)),
+          scratch_(std::exchange(other.scratch_, nullptr)) {}
+
+    Regex&
+    operator=(Regex&& other) noexcept
+    {
+        std::swap(fsm_, other.fsm_);
+        std::swap(scratch_, other.scratch_);
+        return *this;
+    }
+
+    Regex(const Regex&) = delete;
+    Regex& operator=(const Regex&) = delete;
+
+    ~Regex()
+    {
+        re_scratch_free(scratch_);
+        re_free(fsm_);
+    }
+
+    /* The leftmost-longest match in s at or after from, throwing
+     * re::error if s is longer than the library can search */
+    std::optional<std::string_view>
+    search(std::string_view s, std::size_t from = 0)
+    {
+        struct re_matched m;
+
+        if (s.size() > INT_MAX)
+            throw error("string too long to search");
+        if (from > s.size()) return std::nullopt;
+        if (!re_search(fsm_, scratch_, s.data(), static_cast<int>(s.size()),
+                       static_cast<int>(from), &m))
+            return std::nullopt;
+        return s.substr(m.start, m.end - m.start);
+    }
+
+    /* The successive matches in s, found as the range is iterated */
+    range matches(std::string_view s);
+
+private:
+    struct sm_fsm* fsm_ = nullptr;
+    struct re_scratch* scratch_ = nullptr;
+};
+
+/* Each match starts where the last ended, or one on from an empty
+ * match, so that the matches don't overlap and the search moves on */
+class Regex::iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    iterator() = default;
+
+    iterator(Regex* re, std::string_view s) : re_(re), s_(s)
+    {
+        next(0);
+    }
+
+    reference operator*() const { return m_; }
+    pointer operator->() const { return &m_; }
+
+    iterator&
+    operator++()
+    {
+        std::size_t end = m_.data() - s_.data() + m_.size();
+
+        if (m_.empty()) {
+            if (end == s_.size()) {
+                re_ = nullptr;
+                return *this;
+            }
+            end++;
+        }
+        next(end);
+        return *this;
+    }
+
+    iterator
+    operator++(int)
+    {
+        iterator it = *this;
+
+        ++*this;
+        return it;
+    }
+
+    bool operator==(std::default_sentinel_t) const { return re_ == nullptr; }
+
+private:
+    Regex* re_ = nullptr;
+    std::string_view s_;
+    std::string_view m_;
+
+    void
+    next(std::size_t from)
+    {
+        std::optional<std::string_view> m = re_->search(s_, from);
+
+        if (m)
+            m_ = *m;
+        else
+            re_ = nullptr;
+    }
+};
+
+class Regex::range {
+public:
+    range(Regex* re, std::string_view s) : re_(re), s_(s) {}
+
+    iterator begin() const { return iterator(re_, s_); }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    Regex* re_;
+    std::string_view s_;
+};
+
+inline Regex::range
+Regex::matches(std::string_view s)
+{
+    return range(this, s);
+}
+
+} // namespace re
+
+#endif
@@ -0,0 +1,686 @@
+/* Compile time regular expressions
+ *
+ * re::static_regex<"th(ei|ie)r"> parses its pattern while the program
+ * is compiled, with the grammar of expression(), term() and factor()
+ * in re.c carried over to constexpr C++, so the state machine is the
+ * one re_compile builds without RE_OPT.  Subset construction, as in
+ * dfa.c, then turns it into a forward and a reverse DFA, and the DFAs
+ * into constant tables sized for the pattern: byte classes, next
+ * states as narrow as the number of states allows, and acceptance.
+ * Matching is a loop over the tables of that one pattern, with
+ * nothing left to compile or choose at run time.
+ *
+ * The match found is the one re_match finds: the leftmost-longest,
+ * the start by a reverse scan from the end of the string and the end
+ * by a forward scan from there.
+ *
+ * A malformed pattern fails to compile.
+ */
+
+#ifndef RE_STATIC_HPP
+#define RE_STATIC_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "re.h"
+
+namespace re {
+
+/* A string literal as a template argument */
+template <std::size_t N>
+struct fixed_string {
+    char s[N] {};
+
+    constexpr fixed_string(const char (&str)[N])
+    {
+        for (std::size_t i = 0; i < N; i++) s[i] = str[i];
+    }
+
+    constexpr std::string_view
+    view() const
+    {
+        return std::string_view(s, N - 1);
+    }
+};
+
+/* A match, as re_matched, end one past its last character */
+struct match {
+    std::size_t start;
+    std::size_t end;
+};
+
+namespace detail {
+
+enum {
+    LP = -2,                    // lexer tokens, as in re.c
+    RP = -3,
+    OR = -4,
+    CL = -5,
+    AT_START = 1,               // assertions, relative to the scan
+    AT_END = 2,                 // direction, as in dfa.c
+    NO_MATCH = -1,
+    MAX_STATES = 4096,          // in either DFA
+    ERR_SIZE = -1               // DFA too large
+};
+
+using bitmap = std::array<std::uint64_t, 4>;
+
+constexpr bool
+has(const bitmap& b, unsigned char c)
+{
+    return b[c / 64] >> (c % 64) & 1;
+}
+
+struct entry {
+    signed char event = 0;
+    int next1 = 0;
+    int next2 = 0;
+    bitmap cc {};
+};
+
+struct machine {
+    std::vector<entry> fsm;
+    int max_state = 0;
+    int error = 0;
+};
+
+constexpr bool
+consumes(const entry& st)
+{
+    return st.event != RE_NODE && st.event != RE_BOL && st.event != RE_EOL;
+}
+
+constexpr bool
+event_match(const entry& st, unsigned char c)
+{
+    switch (st.event) {
+        case RE_DOT:
+            return true;
+        case RE_CC:
+            return has(st.cc, c);
+        default:
+            return st.event > '\0' && st.event == static_cast<signed char>(c);
+    }
+}
+
+/* A node of the tree of a pattern, as in ast.c: a leaf for an event,
+ * or a sequence, alternation or closure of its children */
+struct node {
+    enum { LEAF, CAT, ALT, STAR } type = LEAF;
+    signed char event = 0;
+    bitmap cc {};
+    int child = 0;
+    int next = 0;               // sibling, 0 if none
+};
+
+/* The compiler of re.c, without the rewrites of RE_OPT.  Where re.c
+ * would longjmp on an error, the error is noted and the lexer returns
+ * '\0' from then on, which unwinds the descent. */
+class parser {
+public:
+    constexpr explicit parser(std::string_view re_str)
+        : buf(re_str), lexend(re_str.size() + 1) {}
+
+    constexpr machine
+    compile()
+    {
+        int t = expression();
+
+        state = 1;
+        if (m.error == 0) insert(0, RE_NODE, emit(t, 0), 0);
+        return std::move(m);
+    }
+
+private:
+    std::string_view buf;
+    std::size_t lexend;
+    std::size_t lexnext = 0;
+    bool started = false;
+    int state = 0;
+    // node 0 stands in for a tree lost to an error
+    std::vector<node> nodes = std::vector<node>(1);
+    machine m;
+
+    constexpr signed char
+    at(std::size_t i) const
+    {
+        return (i < buf.size())?buf[i]:'\0';
+    }
+
+    constexpr void
+    error(int error_code)
+    {
+        if (m.error == 0) m.error = error_code;
+    }
+
+    constexpr void
+    insert(int s, signed char event, int next1, int next2)
+    {
+        if (s >= static_cast<int>(m.fsm.size())) m.fsm.resize(s + 1);
+        // states may be inserted out of order
+        for (int i = m.max_state + 1; i < s; i++) m.fsm[i] = entry {RE_NODE};
+        m.fsm[s] = entry {event, next1, next2};
+        if (s > m.max_state) m.max_state = s;
+    }
+
+    constexpr int
+    add(node n)
+    {
+        nodes.push_back(n);
+        return static_cast<int>(nodes.size()) - 1;
+    }
+
+    constexpr bitmap
+    parse_cc()
+    {
+        bitmap bits {};
+        unsigned char c, endc;
+        bool negate = false, first = true;
+        int last = -1;
+
+        auto set = [&bits](unsigned char b) {
+            bits[b / 64] |= std::uint64_t(1) << (b % 64);
+        };
+        c = at(lexnext++);
+        while (c != ']' && lexnext < lexend) {
+            if (c == '\\') {
+                c = at(lexnext++);
+                set(c);
+                last = c;
+            }
+            else if (c == '^' && first) {
+                negate = true;
+            }
+            else if (c == '-' && last >= 0 && at(lexnext) != ']') {
+                endc = at(lexnext++);
+                for (int t = last+1; t <= endc; t++) set(t);
+                last = endc;
+            }
+            else {
+                set(c);
+                last = c;
+            }
+            first = false;
+            c = at(lexnext++);
+        }
+        if (c != ']') error(RE_ERR_EX);
+        if (negate) {
+            for (auto& w : bits) w = ~w;
+        }
+        return bits;
+    }
+
+    constexpr void
+    unlexch()
+    {
+        if (lexnext > 0) {
+            lexnext--;
+            if (lexnext > 0 && at(lexnext-1) == '\\') lexnext--;
+        }
+    }
+
+    constexpr signed char
+    lexch()
+    {
+        signed char c = '\0';
+
+        if (m.error != 0) return c;
+        if (lexnext < lexend) {
+            c = at(lexnext++);
+            switch (c) {
+                case '(':
+                    c = LP;
+                    break;
+                case ')':
+                    c = RP;
+                    break;
+                case '|':
+                    c = OR;
+                    started = false;
+                    break;
+                case '*':
+                    c = CL;
+                    break;
+                case '\\':
+                    c = at(lexnext++);
+                    break;
+                case '^':
+                    if (!started) c = RE_BOL;
+                    break;
+                case '$':
+                    if (at(lexnext) == '\0' || at(lexnext) == ')' ||
+                        at(lexnext) == '|') c = RE_EOL;
+                    break;
+                case '.':
+                    c = RE_DOT;
+                    break;
+                case '[':
+                    c = RE_CC;
+                    break;
+                default:
+                    // plain character
+                    started = true;
+                    break;
+            }
+        }
+        return c;
+    }
+
+    constexpr int
+    expression()
+    {
+        int t;
+        signed char c;
+
+        t = term();
+        c = lexch();
+        if (c == OR) {
+            int alt = add(node {node::ALT, 0, {}, t});
+            int rest = expression();
+
+            nodes[t].next = rest;
+            return alt;
+        }
+        unlexch();
+        return t;
+    }
+
+    constexpr int
+    term()
+    {
+        int t;
+        signed char c;
+
+        t = factor();
+        c = lexch(); unlexch();
+        if (c > '\0' || (c != OR && c != RP && c != '\0')) {
+            int seq = add(node {node::CAT, 0, {}, t});
+            int rest = term();
+
+            nodes[t].next = rest;
+            return seq;
+        }
+        return t;
+    }
+
+    constexpr int
+    factor()
+    {
+        int t = 0;
+        signed char c;
+
+        c = lexch();
+        if (c == LP) {
+            t = expression();
+            c = lexch();
+            if (c != RP) error(RE_ERR_UP);
+        }
+        else if (c > '\0'  || c == RE_DOT || c == RE_BOL || c == RE_EOL) {
+            t = add(node {node::LEAF, c});
+        }
+        else if (c == RE_CC) {
+            t = add(node {node::LEAF, c, parse_cc()});
+        }
+        else {
+            error(RE_ERR_EX);
+        }
+        if (m.error != 0) return 0;
+        c = lexch();
+        if (c != CL) {
+            unlexch();
+            return t;
+        }
+        return add(node {node::STAR, 0, {}, t});
+    }
+
+    /* The states for tree n, leading on to next, as emit() in re.c */
+    constexpr int
+    emit(int n, int next)
+    {
+        node x = nodes[n];
+        int s;
+
+        switch (x.type) {
+            case node::CAT:
+                return emit_seq(x.child, next);
+            case node::ALT:
+                return emit_alt(x.child, next);
+            case node::STAR:
+                s = state++;
+                insert(s, RE_NODE, emit(x.child, s), next);
+                return s;
+            default:
+                s = state++;
+                insert(s, x.event, next, 0);
+                m.fsm[s].cc = x.cc;
+                return s;
+        }
+    }
+
+    constexpr int
+    emit_seq(int n, int next)
+    {
+        if (n == 0) return next;
+        return emit(n, emit_seq(nodes[n].next, next));
+    }
+
+    constexpr int
+    emit_alt(int n, int next)
+    {
+        int first = emit(n, next), s;
+
+        if (nodes[n].next == 0) return first;
+        s = state++;
+        insert(s, RE_NODE, first, emit_alt(nodes[n].next, next));
+        return s;
+    }
+};
+
+/* A DFA built by subset construction, as dfa_compile builds one but
+ * not minimised.  A DFA state is the set of machine states reached,
+ * with whether it is the initial state at the start of the string. */
+struct dfa {
+    std::array<unsigned char, 256> classes {};
+    int nclasses = 1;
+    std::vector<int> table;         // next state, by state and class
+    std::vector<unsigned char> accepts; // 1 accepting, 2 at the end
+    int init[2] = {0, 0};           // by at start of the scan
+    int dead = NO_MATCH;
+    int nstates = 0;
+    int error = 0;
+};
+
+template <int Words>
+class dfa_builder {
+public:
+    constexpr dfa_builder(const machine& mc, bool reverse)
+        : m(mc), rev(reverse), n(mc.max_state + 1), eps(n) {}
+
+    constexpr dfa
+    build()
+    {
+        dfa d;
+        int bol = rev?AT_END:AT_START, eol = rev?AT_START:AT_END;
+
+        if (m.error != 0) {
+            d.error = m.error;
+            return d;
+        }
+        // epsilon edges in the direction of the scan, with the
+        // assertion each passes
+        for (int u = 1; u < n; u++) {
+            const entry& st = m.fsm[u];
+            int via = (st.event == RE_BOL)?bol:(st.event == RE_EOL)?eol:0;
+
+            if (consumes(st)) continue;
+            add_eps(u, st.next1, via);
+            if (st.event == RE_NODE && st.next2 != st.next1)
+                add_eps(u, st.next2, 0);
+        }
+        byte_classes(d);
+        accept = rev?m.fsm[0].next1:0;
+        for (int a = 0; a < 2; a++) {
+            set seed {};
+
+            add(seed, rev?0:m.fsm[0].next1);
+            d.init[a] = lookup(d, closure(seed, a?AT_START:0), a);
+        }
+        for (int s = 0; s < d.nstates && d.error == 0; s++) {
+            for (int c = 0; c < d.nclasses && d.error == 0; c++) {
+                int to = lookup(d, step(sets[s], c), false);
+
+                d.table[s * d.nclasses + c] = to;
+            }
+        }
+        return d;
+    }
+
+private:
+    using set = std::array<std::uint64_t, Words>;
+
+    struct edge {
+        int to;
+        int via;
+    };
+
+    const machine& m;
+    bool rev;
+    int n;
+    int accept = 0;
+    std::vector<std::vector<edge>> eps;     // by state
+    std::vector<std::vector<int>> by_class; // states consuming each class
+    std::vector<set> sets;                  // of each DFA state
+
+    static constexpr bool
+    in(const set& x, int u)
+    {
+        return x[u / 64] >> (u % 64) & 1;
+    }
+
+    static constexpr void
+    add(set& x, int u)
+    {
+        x[u / 64] |= std::uint64_t(1) << (u % 64);
+    }
+
+    constexpr void
+    add_eps(int u, int v, int via)
+    {
+        if (rev)
+            eps[v].push_back(edge {u, via});
+        else
+            eps[u].push_back(edge {v, via});
+    }
+
+    /* Partition the bytes into classes which no state distinguishes */
+    constexpr void
+    byte_classes(dfa& d)
+    {
+        std::array<unsigned char, 256> newc {};
+
+        for (int u = 1; u < n; u++) {
+            const entry& st = m.fsm[u];
+            int map[512], k = 0;
+
+            if (!consumes(st) || st.event == RE_DOT) continue;
+            for (int i = 0; i < 2 * d.nclasses; i++) map[i] = -1;
+            for (int c = 0; c < 256; c++) {
+                int x = 2 * d.classes[c] + event_match(st, c);
+
+                if (map[x] < 0) map[x] = k++;
+                newc[c] = map[x];
+            }
+            d.classes = newc;
+            d.nclasses = k;
+        }
+        by_class.resize(d.nclasses);
+        for (int k = 0; k < d.nclasses; k++) {
+            int c = 0;
+
+            while (d.classes[c] != k) c++;
+            for (int u = 1; u < n; u++) {
+                if (consumes(m.fsm[u]) && event_match(m.fsm[u], c))
+                    by_class[k].push_back(u);
+            }
+        }
+    }
+
+    /* Add the states reached over epsilon transitions in the direction
+     * of the scan, passing the assertions in allow */
+    constexpr set
+    closure(set x, int allow)
+    {
+        int stack[Words * 64], sp = 0;
+
+        for (int w = 0; w < Words; w++) {
+            for (std::uint64_t b = x[w]; b != 0; b &= b - 1) {
+                int u = 64 * w + std::countr_zero(b);
+
+                if (u < n) stack[sp++] = u;
+            }
+        }
+        while (sp > 0) {
+            int u = stack[--sp];
+
+            for (const edge& e : eps[u]) {
+                if ((e.via & ~allow) || in(x, e.to)) continue;
+                add(x, e.to);
+                stack[sp++] = e.to;
+            }
+        }
+        return x;
+    }
+
+    /* The states following x over byte class c, then their closure */
+    constexpr set
+    step(const set& x, int c)
+    {
+        set next {};
+
+        for (int u : by_class[c]) {
+            if (rev && in(x, m.fsm[u].next1))
+                add(next, u);
+            else if (!rev && in(x, u))
+                add(next, m.fsm[u].next1);
+        }
+        // unanchored, a match may start anywhere
+        if (rev) add(next, 0);
+        return closure(next, 0);
+    }
+
+    constexpr int
+    lookup(dfa& d, set x, bool start)
+    {
+        const set* p = sets.data();
+
+        // the initial state at the start is told apart by bit n
+        if (start) add(x, n);
+        for (int s = 0; s < d.nstates; s++) {
+            bool same = true;
+
+            for (int w = 0; same && w < Words; w++) same = p[s][w] == x[w];
+            if (same) return s;
+        }
+        if (d.nstates == MAX_STATES) {
+            d.error = ERR_SIZE;
+            return 0;
+        }
+        d.accepts.push_back(in(x, accept) |
+            2 * in(closure(x, AT_END | (start?AT_START:0)), accept));
+        if (x == set {}) d.dead = d.nstates;
+        d.table.resize(d.table.size() + d.nclasses, 0);
+        sets.push_back(x);
+        return d.nstates++;
+    }
+};
+
+/* The size of a pattern's machine and DFA, and any error */
+struct shape {
+    int error;
+    int states;                 // in the machine
+    int nstates;                // in the DFA
+    int nclasses;
+};
+
+template <fixed_string P, bool Reverse>
+constexpr shape
+shape_of()
+{
+    constexpr int states = parser(P.view()).compile().max_state + 1;
+    machine m = parser(P.view()).compile();
+
+    if (m.error != 0) return shape {m.error, states, 1, 1};
+    dfa d = dfa_builder<states / 64 + 1>(m, Reverse).build();
+    return shape {d.error, states, std::max(d.nstates, 1), d.nclasses};
+}
+
+/* The next state type, as narrow as the states allow */
+template <std::size_t States>
+using state_t = std::conditional_t<(States <= 256), std::uint8_t,
+                                   std::uint16_t>;
+
+/* A DFA as constant tables */
+template <std::size_t States, std::size_t Classes>
+struct table {
+    std::array<unsigned char, 256> classes {};
+    std::array<state_t<States>, States * Classes> next {};
+    std::array<unsigned char, States> accepts {};
+    int init[2] = {0, 0};
+    int dead = NO_MATCH;
+
+    /* As dfa_scan: the longest match from, forward, or with reverse
+     * the leftmost start of one, scanning back from len */
+    constexpr int
+    scan(std::string_view s, int from, bool reverse) const
+    {
+        int len = s.size(), j = from, last = NO_MATCH;
+        int st = init[from == (reverse?len:0)];
+
+        for (;;) {
+            if (j == (reverse?0:len)) return (accepts[st] & 2)?j:last;
+            if (accepts[st] & 1) last = j;
+            unsigned char c = s[reverse?--j:j++];
+            st = next[st * Classes + classes[c]];
+            if (st == dead) return last;
+        }
+    }
+};
+
+template <fixed_string P, bool Reverse, shape Shape>
+constexpr auto
+freeze()
+{
+    machine m = parser(P.view()).compile();
+    dfa d = dfa_builder<Shape.states / 64 + 1>(m, Reverse).build();
+    table<Shape.nstates, Shape.nclasses> t;
+
+    if (d.error != 0) return t;
+    t.classes = d.classes;
+    for (int i = 0; i < d.nstates * d.nclasses; i++) t.next[i] = d.table[i];
+    for (int s = 0; s < d.nstates; s++) t.accepts[s] = d.accepts[s];
+    t.init[0] = d.init[0];
+    t.init[1] = d.init[1];
+    t.dead = d.dead;
+    return t;
+}
+
+} // namespace detail
+
+template <fixed_string P>
+class static_regex {
+    static constexpr detail::shape fwd_shape = detail::shape_of<P, false>();
+    static constexpr detail::shape rev_shape = detail::shape_of<P, true>();
+    static_assert(fwd_shape.error != RE_ERR_UP, "unbalanced parentheses");
+    static_assert(fwd_shape.error != RE_ERR_EX, "malformed expression");
+    static_assert(fwd_shape.error == 0 && rev_shape.error == 0,
+                  "DFA too large");
+
+    static constexpr auto fwd = detail::freeze<P, false, fwd_shape>();
+    static constexpr auto rev = detail::freeze<P, true, rev_shape>();
+
+public:
+    static constexpr std::string_view pattern = P.view();
+
+    /* The leftmost-longest match in s */
+    static constexpr std::optional<match>
+    search(std::string_view s)
+    {
+        int start = rev.scan(s, s.size(), true);
+
+        if (start < 0) return std::nullopt;
+        return match {static_cast<std::size_t>(start),
+                      static_cast<std::size_t>(fwd.scan(s, start, false))};
+    }
+};
+
+} // namespace re
+
+#endif
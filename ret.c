@@ -22,7 +22,7 @@ main(int argc, char* argv[])
     char* program = argv[0];
     struct re_matched* matched;
     struct sm_fsm* fsm;
-    bool do_match = true;
+    bool do_match = true, generate = false;
     int error_code, re_compile_flags = RE_OPT;
 
     while (--argc > 0 && (*++argv)[0] == '-') {
@@ -35,7 +35,23 @@ main(int argc, char* argv[])
                     do_match = false;
                     break;
                 case 'o':
-                    re_compile_flags = 0;
+                    re_compile_flags &= ~RE_OPT;
+                    break;
+                case 'p':
+                    re_compile_flags |= RE_NFA;
+                    break;
+                case 'd':
+                    re_compile_flags |= RE_DFA;
+                    break;
+                case 'b':
+                    re_compile_flags |= RE_BP;
+                    break;
+                case 'j':
+                    re_compile_flags |= RE_JIT;
+                    break;
+                case 'g':
+                    re_compile_flags |= RE_DFA;
+                    generate = true;
                     break;
                 default:
                     fprintf(stderr,"%s: unknown switch: -%c\n",program,*s);
@@ -49,7 +65,15 @@ main(int argc, char* argv[])
             fprintf(stderr,"ret: %s\n",re_error_msg());
             return EXIT_FAILURE;
         }
-        if (debug) sm_print(fsm);
+        if (debug) {
+            sm_print(fsm);
+            re_footprint(fsm, stderr);
+        }
+        if (generate) {
+            if (re_generate(fsm, argv[0], stdout)) return EXIT_SUCCESS;
+            fprintf(stderr,"%s: %s\n",program, re_error_msg());
+            return EXIT_FAILURE;
+        }
         if (!do_match) return EXIT_SUCCESS;
 
         while (fgets(search,BUFSIZE,stdin)) {
@@ -63,6 +87,7 @@ main(int argc, char* argv[])
                 fprintf(stderr,"%s: %s\n",program, re_error_msg());
             }
         }
+        re_free(fsm);
     }
     else {
         fprintf(stderr,"%s: regex required\n",program);
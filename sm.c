@@ -1,68 +1,192 @@
-/* state machine */
+/* state machine
+ *
+ * A machine and all a compiled regex keeps are allocated from the
+ * machine's arena.  States are grown in steps as the compiler emits
+ * them, and moved to the arena at their size by sm_trim once it is
+ * done, so that a compiled machine takes 8 bytes a state and a pointer
+ * for each distinct class. */
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "sm.h"
+#include "mem.h"
 
 enum {
-    ALLOC_SIZE = 64
+    ALLOC_SIZE = 64,
+    ARENA_BLOCK = 256,          // most regexes need only a few
+    CLASS_HASH_SIZE = 251
 };
 
-static struct sm_entry* machine;
-static struct sm_fsm* fsm;
-static int nstates;
-static int max_state;
+/* character classes in use by any machine, for sharing */
+static struct sm_class* classes[CLASS_HASH_SIZE];
+static pthread_mutex_t classes_lock = PTHREAD_MUTEX_INITIALIZER;
 
-bool
+struct sm_fsm*
 sm_init(void)
 {
-    fsm = (struct sm_fsm*) malloc(sizeof(struct sm_fsm));
-    max_state = 0;
-    nstates = ALLOC_SIZE;
-    machine = (struct sm_entry*)
-        realloc(NULL, sizeof(struct sm_entry) * nstates);
-    return machine != NULL;
-}
+    struct sm_fsm* fsm;
+    struct arena* arena;
 
-struct sm_fsm*
-sm_get(void)
-{
-    fsm->fsm = machine;
-    fsm->max_state = max_state;
+    if ((arena = arena_init(ARENA_BLOCK)) == NULL) return NULL;
+    fsm = (struct sm_fsm*) arena_alloc(arena, sizeof(struct sm_fsm));
+    if (fsm == NULL) {
+        arena_free(arena);
+        return NULL;
+    }
+    fsm->arena = arena;
+    fsm->trimmed = false;
+    fsm->fwd = fsm->rev = NULL;
+    fsm->ac = NULL;
+    fsm->teddy = NULL;
+    fsm->bmh = NULL;
+    fsm->gk = NULL;
+    fsm->prog = NULL;
+    fsm->max_str = 0;
+    fsm->bol = false;
+    fsm->serial = 0;
+    fsm->prefix = NULL;
+    fsm->prefix_len = 0;
+    fsm->required = NULL;
+    fsm->required_len = fsm->rare = 0;
+    fsm->classes = NULL;
+    fsm->nclasses = fsm->max_classes = 0;
+    fsm->max_state = 0;
+    fsm->nstates = ALLOC_SIZE;
+    fsm->fsm = (struct sm_entry*)
+        mem_alloc(sizeof(struct sm_entry) * fsm->nstates);
+    if (fsm->fsm == NULL) {
+        arena_free(arena);
+        return NULL;
+    }
     return fsm;
 }
 
 void
-sm_set(struct sm_fsm* m)
+sm_free(struct sm_fsm* fsm)
 {
-    machine = m->fsm;
-    max_state = fsm->max_state;
-    return;
+    for (int i = 0; i < fsm->nclasses; i++) sm_class_release(fsm->classes[i]);
+    if (!fsm->trimmed) {
+        mem_free(fsm->classes);
+        mem_free(fsm->fsm);
+    }
+    arena_free(fsm->arena);
 }
 
 bool
-sm_insert(int state, signed char event, int next1, int next2)
+sm_insert(struct sm_fsm* fsm, int state, signed char event, int next1,
+          int next2)
 {
-    if (state >= nstates) {
+    struct sm_entry* machine;
+
+    if (state >= SM_MAX_STATES) return false;
+    if (state >= fsm->nstates) {
         // add more state capacity
-        nstates += ALLOC_SIZE;
-        machine = (struct sm_entry*) realloc(machine,
-                                        sizeof(struct sm_entry) * nstates);
-        if (machine == NULL || state > nstates) return false;
+        machine = (struct sm_entry*) mem_realloc(fsm->fsm,
+                    sizeof(struct sm_entry) * (fsm->nstates + ALLOC_SIZE));
+        if (machine == NULL) return false;
+        fsm->fsm = machine;
+        fsm->nstates += ALLOC_SIZE;
+        if (state >= fsm->nstates) return false;
     }
-    machine[state].event = event;
-    machine[state].next1 = next1;
-    machine[state].next2 = next2;
-    if (state > max_state) max_state = state;
+    // states may be inserted out of order
+    for (int i = fsm->max_state + 1; i < state; i++) {
+        fsm->fsm[i].event = RE_NODE;
+        fsm->fsm[i].next1 = fsm->fsm[i].next2 = 0;
+    }
+    fsm->fsm[state].event = event;
+    fsm->fsm[state].next1 = next1;
+    fsm->fsm[state].next2 = next2;
+    if (state > fsm->max_state) fsm->max_state = state;
     return true;
 }
 
 struct sm_entry*
-sm_state(int state)
+sm_state(struct sm_fsm* fsm, int state)
+{
+    return (state <= fsm->max_state)?fsm->fsm+state:NULL;
+
+}
+
+/* The index of cls in the machine's classes, adding it, with a
+ * reference of its own, if it isn't there.  -1 if out of memory. */
+int
+sm_class_add(struct sm_fsm* fsm, struct sm_class* cls)
 {
-    return (state <= max_state)?machine+state:NULL;
+    struct sm_class** classes;
+    int i;
 
+    for (i = 0; i < fsm->nclasses; i++) {
+        if (fsm->classes[i] == cls) return i;
+    }
+    if (fsm->nclasses == fsm->max_classes) {
+        classes = (struct sm_class**) mem_realloc(fsm->classes,
+                    sizeof(struct sm_class*) * (fsm->max_classes + ALLOC_SIZE));
+        if (classes == NULL) return -1;
+        fsm->classes = classes;
+        fsm->max_classes += ALLOC_SIZE;
+    }
+    pthread_mutex_lock(&classes_lock);
+    cls->refs++;
+    pthread_mutex_unlock(&classes_lock);
+    fsm->classes[fsm->nclasses] = cls;
+    return fsm->nclasses++;
+}
+
+/* Drop the classes no state uses any more and move the states and
+ * classes to the arena, taking no more room than they need.  No more
+ * states may be inserted.  false if out of memory, leaving the machine
+ * as it was but for the classes dropped. */
+bool
+sm_trim(struct sm_fsm* fsm)
+{
+    int* number, n = 0;
+    struct sm_entry* machine;
+    struct sm_class** classes = NULL;
+
+    if ((number = mem_calloc(fsm->nclasses + 1, sizeof(int))) == NULL)
+        return false;
+    for (int u = 1; u <= fsm->max_state; u++) {
+        if (fsm->fsm[u].event == RE_CC) number[fsm->fsm[u].next2] = 1;
+    }
+    for (int i = 0; i < fsm->nclasses; i++) {
+        if (number[i]) {
+            fsm->classes[n] = fsm->classes[i];
+            number[i] = n++;
+        }
+        else
+            sm_class_release(fsm->classes[i]);
+    }
+    for (int u = 1; u <= fsm->max_state; u++) {
+        if (fsm->fsm[u].event == RE_CC)
+            fsm->fsm[u].next2 = number[fsm->fsm[u].next2];
+    }
+    mem_free(number);
+    fsm->nclasses = n;
+    machine = arena_copy(fsm->arena, fsm->fsm,
+                         sizeof(struct sm_entry) * (fsm->max_state + 1));
+    if (n > 0) classes = arena_copy(fsm->arena, fsm->classes,
+                                    n * sizeof(*classes));
+    if (machine == NULL || (n > 0 && classes == NULL)) return false;
+    mem_free(fsm->fsm);
+    mem_free(fsm->classes);
+    fsm->fsm = machine;
+    fsm->nstates = fsm->max_state + 1;
+    fsm->classes = classes;
+    fsm->max_classes = n;
+    fsm->trimmed = true;
+    return true;
+}
+
+/* Bytes of the machine's states and class table.  The classes
+ * themselves are shared with other machines and not counted. */
+size_t
+sm_size(struct sm_fsm* fsm)
+{
+    return sizeof(struct sm_fsm) + fsm->nstates * sizeof(struct sm_entry)
+        + fsm->max_classes * sizeof(struct sm_class*);
 }
 
 void
@@ -75,3 +199,64 @@ sm_print(struct sm_fsm* sm)
                fsm[i].next2);
     }
 }
+
+/* true if the character c satisfies the event of state st */
+bool
+sm_event_match(struct sm_fsm* fsm, struct sm_entry* st, unsigned char c)
+{
+    switch (st->event) {
+        case RE_DOT:
+            return true;
+        case RE_CC:
+            return SM_CLASS_HAS(fsm->classes[st->next2]->bits, c);
+        default:
+            return st->event > '\0' && st->event == c;
+    }
+}
+
+static unsigned
+class_hash(unsigned char* bits)
+{
+    unsigned h = 0;
+
+    for (int i = 0; i < SM_CLASS_BYTES; i++) h = h * 31 + bits[i];
+    return h % CLASS_HASH_SIZE;
+}
+
+/* The shared class with the members in bits, made if need be */
+struct sm_class*
+sm_class_intern(unsigned char* bits)
+{
+    struct sm_class* cls;
+    unsigned h = class_hash(bits);
+
+    pthread_mutex_lock(&classes_lock);
+    for (cls = classes[h]; cls != NULL; cls = cls->next) {
+        if (memcmp(cls->bits, bits, SM_CLASS_BYTES) == 0) break;
+    }
+    if (cls == NULL && (cls = mem_alloc(sizeof(struct sm_class))) != NULL) {
+        memcpy(cls->bits, bits, SM_CLASS_BYTES);
+        mem_owner(&cls->release, &cls->ctx);
+        cls->refs = 0;
+        cls->next = classes[h];
+        classes[h] = cls;
+    }
+    if (cls != NULL) cls->refs++;
+    pthread_mutex_unlock(&classes_lock);
+    return cls;
+}
+
+void
+sm_class_release(struct sm_class* cls)
+{
+    struct sm_class** p;
+
+    pthread_mutex_lock(&classes_lock);
+    if (--cls->refs == 0) {
+        p = &classes[class_hash(cls->bits)];
+        while (*p != cls) p = &(*p)->next;
+        *p = cls->next;
+        cls->release(cls->ctx, cls);
+    }
+    pthread_mutex_unlock(&classes_lock);
+}
@@ -1,24 +1,87 @@
 #ifndef SM_H
 #define SM_H
 
+#include <stddef.h>
+
+/* state events, other than characters to match
+ * negative values for events requires signed char */
+enum {
+    RE_NODE = -1,
+    RE_BOL = -6,
+    RE_EOL = -7,
+    RE_DOT = -8,
+    RE_CC = -11
+};
+
+enum {
+    SM_CLASS_BYTES = 32,    // 256 bit character class
+    SM_MAX_STATES = 1 << 23 // states numbered in next2's 24 bits
+};
+
+#define SM_CLASS_SET(bits, c) ((bits)[(c) >> 3] |= 1 << ((c) & 7))
+#define SM_CLASS_HAS(bits, c) (((bits)[(c) >> 3] >> ((c) & 7)) & 1)
+
+/* character class, shared by all states with the same class */
+struct sm_class {
+    unsigned char bits[SM_CLASS_BYTES];
+    int refs;
+    struct sm_class* next;
+    void (*release)(void*, void*);  // and ctx, the allocator to free it to
+    void* ctx;
+};
+
+/* A state in 8 bytes.  next2 is only a transition of a RE_NODE; for
+ * a RE_CC it is the index of the class in the machine's classes. */
 struct sm_entry {
-    signed char event;
-    char *cc;
     int next1;
-    int next2;
+    signed int next2 : 24;
+    signed int event : 8;
 };
 
 struct sm_fsm {
+    struct arena* arena;    // everything below, once trimmed
     struct sm_entry* fsm;
     int max_state;
+    int nstates;        // allocated
+    struct sm_class** classes;  // of the RE_CC states, one reference each
+    int nclasses;
+    int max_classes;    // allocated
+    bool trimmed;       // states and classes moved to the arena
+    struct dfa* fwd;    // anchored forward DFA, finds the end of a match
+    struct dfa* rev;    // unanchored reverse DFA, finds the start
+    char* prefix;       // literal every match starts with, or NULL
+    int prefix_len;
+    char* required;     // literal every match contains, or NULL
+    int required_len;
+    int rare;           // offset of its least common byte
+    struct ac* ac;      // for alternates of plain literals, or NULL
+    struct teddy* teddy;    // set of literals a match starts with, or NULL
+    struct bmh* bmh;    // for a pattern that is a plain string, or NULL
+    struct glushkov* gk;    // bit-parallel simulation, or NULL
+    struct re_inst* prog;   // bytecode for the matcher
+    int max_str;        // longest literal run in it
+    bool bol;           // has a '^'
+    unsigned long serial;   // tells apart regexes at the same address
 };
 
+#ifdef __cplusplus
+extern "C" {
+#endif
 
-bool sm_init(void);
-struct sm_fsm* sm_get(void);
-void sm_set(struct sm_fsm*);
-bool sm_insert(int, signed char, int, int);
-struct sm_entry* sm_state(int);
+struct sm_fsm* sm_init(void);
+void sm_free(struct sm_fsm*);
+bool sm_insert(struct sm_fsm*, int, signed char, int, int);
+struct sm_entry* sm_state(struct sm_fsm*, int);
+int sm_class_add(struct sm_fsm*, struct sm_class*);
+bool sm_trim(struct sm_fsm*);
+size_t sm_size(struct sm_fsm*);
 void sm_print(struct sm_fsm*);
+bool sm_event_match(struct sm_fsm*, struct sm_entry*, unsigned char);
+struct sm_class* sm_class_intern(unsigned char*);
+void sm_class_release(struct sm_class*);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
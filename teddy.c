@@ -0,0 +1,198 @@
+/* Teddy multiple literal search
+ *
+ * Finds the first place any of a small set of literals occurs, as a
+ * prefilter for patterns that must start with one of them.  The
+ * literals are spread over 8 buckets.  For each of the first few
+ * bytes of the literals there are two 16 byte tables, indexed by the
+ * low and high nibble of a byte, giving the buckets with a literal
+ * that has that nibble at that offset.  A byte shuffle looks up 16
+ * positions of the string at once; the AND of the lookups over the
+ * offsets leaves the buckets that may match at each position, which
+ * are then checked in full.  Without SSSE3 the same tables are used a
+ * byte at a time.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEDDY_SSSE3
+#endif
+
+#include "re.h"
+#include "teddy.h"
+#include "mem.h"
+
+enum {
+    TEDDY_BUCKETS = 8,
+    TEDDY_MASKS = 3             // leading bytes looked up
+};
+
+struct literal {
+    char* s;
+    int len;
+};
+
+struct teddy {
+    struct arena* arena;        // the search's memory
+    struct literal lit[TEDDY_MAX_LITERALS];
+    int nlit;
+    int nmasks;                 // the shortest literal, up to TEDDY_MASKS
+    unsigned char lo[TEDDY_MASKS][16];
+    unsigned char hi[TEDDY_MASKS][16];
+    unsigned char bucket[TEDDY_BUCKETS][TEDDY_MAX_LITERALS];
+    int nbucket[TEDDY_BUCKETS];
+    const char* (*find)(struct teddy*, const char*, int);
+};
+
+/* An empty set of literals, allocated from arena */
+struct teddy*
+teddy_init(struct arena* arena)
+{
+    struct teddy* t;
+
+    if ((t = arena_calloc(arena, 1, sizeof(struct teddy))) != NULL)
+        t->arena = arena;
+    return t;
+}
+
+size_t
+teddy_size(struct teddy* t)
+{
+    size_t size;
+
+    if (t == NULL) return 0;
+    size = sizeof(struct teddy);
+    for (int i = 0; i < t->nlit; i++) size += t->lit[i].len;
+    return size;
+}
+
+/* Add the literal of len bytes at s, false if there are too many */
+bool
+teddy_add(struct teddy* t, const char* s, int len)
+{
+    if (t->nlit == TEDDY_MAX_LITERALS || len == 0) return false;
+    if ((t->lit[t->nlit].s = arena_copy(t->arena, s, len)) == NULL)
+        return false;
+    t->lit[t->nlit++].len = len;
+    return true;
+}
+
+/* Check the literals of the buckets in bits at p, of the len bytes at
+ * s */
+static bool
+verify(struct teddy* t, unsigned bits, const char* s, int len, int p)
+{
+    struct literal* l;
+
+    for (int b = 0; bits != 0; b++, bits >>= 1) {
+        if (!(bits & 1)) continue;
+        for (int i = 0; i < t->nbucket[b]; i++) {
+            l = t->lit + t->bucket[b][i];
+            if (p + l->len <= len && memcmp(s + p, l->s, l->len) == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+/* The candidates at p, from the tables a byte at a time */
+static unsigned
+candidates(struct teddy* t, const unsigned char* s, int p)
+{
+    unsigned bits = 0xff;
+
+    for (int i = 0; i < t->nmasks; i++)
+        bits &= t->lo[i][s[p+i] & 0xf] & t->hi[i][s[p+i] >> 4];
+    return bits;
+}
+
+static const char*
+find_bytes(struct teddy* t, const char* s, int len, int p)
+{
+    for (; p + t->nmasks <= len; p++) {
+        unsigned bits = candidates(t, (const unsigned char*) s, p);
+        if (bits != 0 && verify(t, bits, s, len, p)) return s + p;
+    }
+    return NULL;
+}
+
+static const char*
+find_scalar(struct teddy* t, const char* s, int len)
+{
+    return find_bytes(t, s, len, 0);
+}
+
+#ifdef TEDDY_SSSE3
+__attribute__((target("ssse3")))
+static const char*
+find_ssse3(struct teddy* t, const char* s, int len)
+{
+    __m128i lo[TEDDY_MASKS], hi[TEDDY_MASKS], res, c;
+    __m128i nibble = _mm_set1_epi8(0xf), zero = _mm_setzero_si128();
+    unsigned mask;
+    int p, b;
+
+    for (int i = 0; i < t->nmasks; i++) {
+        lo[i] = _mm_loadu_si128((const __m128i*) t->lo[i]);
+        hi[i] = _mm_loadu_si128((const __m128i*) t->hi[i]);
+    }
+    // 16 positions at a time, while all the bytes looked up are there
+    for (p = 0; p + 16 + t->nmasks - 1 <= len; p += 16) {
+        res = _mm_set1_epi8(-1);
+        for (int i = 0; i < t->nmasks; i++) {
+            c = _mm_loadu_si128((const __m128i*) (s + p + i));
+            res = _mm_and_si128(res, _mm_and_si128(
+                      _mm_shuffle_epi8(lo[i], _mm_and_si128(c, nibble)),
+                      _mm_shuffle_epi8(hi[i], _mm_and_si128(
+                          _mm_srli_epi16(c, 4), nibble))));
+        }
+        mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(res, zero)) & 0xffff;
+        while (mask != 0) {
+            b = __builtin_ctz(mask);
+            if (verify(t, candidates(t, (const unsigned char*) s, p + b),
+                       s, len, p + b)) return s + p + b;
+            mask &= mask - 1;
+        }
+    }
+    return find_bytes(t, s, len, p);
+}
+#endif
+
+/* Build the nibble tables once all the literals are added */
+void
+teddy_compile(struct teddy* t)
+{
+    int b;
+    unsigned char c;
+
+    t->nmasks = TEDDY_MASKS;
+    for (int i = 0; i < t->nlit; i++) {
+        if (t->lit[i].len < t->nmasks) t->nmasks = t->lit[i].len;
+    }
+    for (int i = 0; i < t->nlit; i++) {
+        b = i % TEDDY_BUCKETS;
+        t->bucket[b][t->nbucket[b]++] = i;
+        for (int k = 0; k < t->nmasks; k++) {
+            c = t->lit[i].s[k];
+            t->lo[k][c & 0xf] |= 1 << b;
+            t->hi[k][c >> 4] |= 1 << b;
+        }
+    }
+    t->find = find_scalar;
+#ifdef TEDDY_SSSE3
+    if (__builtin_cpu_supports("ssse3")) t->find = find_ssse3;
+#endif
+    DEBUGV("teddy: %d literals, %d masks, %s\n", t->nlit, t->nmasks,
+           t->find == find_scalar?"scalar":"ssse3");
+}
+
+/* The first place in the len bytes at s any literal occurs, or NULL */
+const char*
+teddy_find(struct teddy* t, const char* s, int len)
+{
+    return t->find(t, s, len);
+}
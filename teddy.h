@@ -0,0 +1,19 @@
+#ifndef TEDDY_H
+#define TEDDY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+enum {
+    TEDDY_MAX_LITERALS = 64
+};
+
+struct arena;
+
+struct teddy* teddy_init(struct arena*);
+bool teddy_add(struct teddy*, const char*, int);
+void teddy_compile(struct teddy*);
+size_t teddy_size(struct teddy*);
+const char* teddy_find(struct teddy*, const char*, int);
+
+#endif
@@ -0,0 +1,235 @@
+/* Check that matching stops allocating once warmed up: through
+ * re_match, with a scratch of the caller's and with the lazy DFA's
+ * cache flushed over and over.  An allocator set with re_set_allocator
+ * counts the calls, and what is left allocated once all is freed.
+ *
+ * Each search is made again with a scratch given a budget, a different
+ * one each round, and carried on call after call until it ends.  It
+ * must find what the search without one does, and not allocate either. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../re.h"
+
+enum {
+    NTEXT = 4000,               // characters in the text searched
+    WARMUP = 2,                 // rounds, a DFA cache refilled after a
+    ROUNDS = 3                  //   flush may take a block more
+};
+
+static long nalloc, live;
+static int failed = 0;
+
+static void*
+count_alloc(void* ctx, size_t size)
+{
+    void* p = malloc(size);
+
+    (void) ctx;
+    if (p != NULL) {
+        nalloc++;
+        live++;
+    }
+    return p;
+}
+
+static void*
+count_resize(void* ctx, void* p, size_t size)
+{
+    void* q = realloc(p, size);
+
+    (void) ctx;
+    if (q != NULL) {
+        nalloc++;
+        if (p == NULL) live++;
+    }
+    return q;
+}
+
+static void
+count_release(void* ctx, void* p)
+{
+    (void) ctx;
+    if (p != NULL) live--;
+    free(p);
+}
+
+static void
+check(bool ok, const char* what, const char* pattern, int flags)
+{
+    if (ok) return;
+    if (pattern != NULL)
+        printf("failed: %s: %s, flags %d\n", what, pattern, flags);
+    else
+        printf("failed: %s, flags %d\n", what, flags);
+    failed++;
+}
+
+/* Patterns for each engine and fast path.  The last has more DFA
+ * states than the lazy DFA caches, so scans flush, and give up. */
+static const char* patterns[] = {
+    "needle",
+    "he|she|his|hers",
+    "th(ei|ie)r",
+    "[a-c][a-c]*e*",
+    "^ab|ba$",
+    "a.*b.*a",
+    "(ab|b|bbaba|baba)",
+    "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)"
+};
+
+enum {
+    NPATTERNS = sizeof(patterns) / sizeof(patterns[0]),
+    NPOOLED = 4                 // matched in turn with re_match
+};
+
+// matcher steps a budgeted search may take a call, a round each
+static const long budgets[WARMUP + ROUNDS] = { 1, 2, 7, 100, 5000 };
+
+/* true if pattern is searched for by the literal searches alone, in
+ * constant time a character, so isn't budgeted */
+static bool
+literal(const char* pattern, int flags)
+{
+    return strpbrk(pattern, ".*[]()^$") == NULL &&
+        !(flags & (RE_NFA|RE_DFA|RE_BP));
+}
+
+/* Search as re_search does with the budgeted scratch rs, carrying the
+ * search on until it ends, counting the calls in *calls */
+static bool
+find(struct sm_fsm* fsm, struct re_scratch* rs, const char* s, int len,
+     int from, struct re_matched* m, long* calls)
+{
+    bool found;
+
+    do {
+        found = re_search(fsm, rs, s, len, from, m);
+        (*calls)++;
+    } while (!found && re_error_code == RE_ERR_BUDGET);
+    return found;
+}
+
+/* Search all of text with each regex in turn, as the matches of a
+ * range are found, with rs and again with brs, given budget */
+static void
+search_all(struct sm_fsm** fsm, struct re_scratch** rs,
+           struct re_scratch** brs, long budget, const char* text, int len,
+           int flags)
+{
+    struct re_matched m, bm;
+    long calls, searches;
+    bool found;
+
+    for (int i = 0; i < NPATTERNS; i++) {
+        calls = searches = 0;
+        for (int from = 0; from <= len; ) {
+            searches++;
+            found = re_search(fsm[i], rs[i], text, len, from, &m);
+            check(find(fsm[i], brs[i], text, len, from, &bm, &calls) == found
+                  && (!found || (bm.start == m.start && bm.end == m.end)),
+                  "budgeted search found the same", patterns[i], flags);
+            if (!found) break;
+            from = (m.end > from)?m.end:from+1;
+        }
+        check(!literal(patterns[i], flags) || calls == searches,
+              "literal search not budgeted", patterns[i], flags);
+        check(literal(patterns[i], flags) || budget > 1 || calls > searches,
+              "budget kept", patterns[i], flags);
+    }
+}
+
+/* re_match with a line at a time, the regexes taking turns */
+static void
+match_lines(struct sm_fsm** fsm, char* text, int len)
+{
+    char save;
+
+    for (int j = 0; j + 80 <= len; j += 80) {
+        save = text[j+80];
+        text[j+80] = '\0';
+        for (int i = 0; i < NPOOLED; i++) re_match(fsm[i], text+j);
+        text[j+80] = save;
+    }
+}
+
+/* A budgeted search stopped part way, then one of another string,
+ * which must be searched afresh */
+static void
+abandon(struct sm_fsm* fsm, struct re_scratch* rs, struct re_scratch* brs,
+        const char* text, int len, const char* pattern, int flags)
+{
+    struct re_matched m, bm;
+    long calls = 0;
+    bool found;
+
+    re_scratch_budget(brs, 3);
+    if (re_search(fsm, brs, text, len, 0, &bm) ||
+        re_error_code != RE_ERR_BUDGET)
+        return;
+    found = find(fsm, brs, text + 1, len - 1, 0, &bm, &calls);
+    check(found == re_search(fsm, rs, text + 1, len - 1, 0, &m) &&
+          (!found || (bm.start == m.start && bm.end == m.end)),
+          "another string searched afresh", pattern, flags);
+}
+
+static void
+run(int flags, char* text, int len)
+{
+    struct sm_fsm* fsm[NPATTERNS];
+    struct re_scratch* rs[NPATTERNS], *brs[NPATTERNS];
+    long before = 0;
+
+    for (int i = 0; i < NPATTERNS; i++) {
+        fsm[i] = re_compile((char*) patterns[i], flags);
+        rs[i] = (fsm[i] != NULL)?re_scratch_init(fsm[i]):NULL;
+        brs[i] = (fsm[i] != NULL)?re_scratch_init(fsm[i]):NULL;
+        if (rs[i] == NULL || brs[i] == NULL) {
+            check(false, re_error_msg(), patterns[i], flags);
+            return;
+        }
+    }
+    for (int r = 0; r < WARMUP + ROUNDS; r++) {
+        if (r == WARMUP) before = nalloc;
+        for (int i = 0; i < NPATTERNS; i++)
+            re_scratch_budget(brs[i], budgets[r]);
+        search_all(fsm, rs, brs, budgets[r], text, len, flags);
+        match_lines(fsm, text, len);
+    }
+    check(nalloc == before, "allocated once warmed up", NULL, flags);
+    for (int i = 0; i < NPATTERNS; i++) {
+        abandon(fsm[i], rs[i], brs[i], text, len, patterns[i], flags);
+        re_scratch_free(rs[i]);
+        re_scratch_free(brs[i]);
+        re_free(fsm[i]);
+    }
+}
+
+int
+main(void)
+{
+    struct re_allocator counter = {
+        count_alloc, count_resize, count_release, NULL
+    };
+    static const int flags[] = {
+        0, RE_OPT, RE_OPT|RE_NFA, RE_OPT|RE_DFA, RE_OPT|RE_BP,
+        RE_OPT|RE_DFA|RE_JIT
+    };
+    static char text[NTEXT+1];
+    const char* words = "needle their thier hers abcde ";
+
+    srand(1);
+    for (int j = 0; j < NTEXT; j++)
+        text[j] = (j % 400 < 300)?"ab"[rand() % 2]:words[j % 29];
+    re_set_allocator(&counter);
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+        run(flags[i], text, NTEXT);
+        check(live == 0, "all freed", NULL, flags[i]);
+    }
+    re_set_allocator(NULL);
+    printf("%d failures\n", failed);
+    return failed == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
@@ -0,0 +1,326 @@
+#define RE_GENERATED_NAME gen_match
+/* Generated by ret -g from the regular expression
+ *
+ *      ^th(ei|ie)r$|[0-9][0-9]*\.[0-9]*|x*y
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef RE_GENERATED_NAME
+#define RE_GENERATED_NAME re_generated
+#endif
+
+static const unsigned char rev_scan_classes[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,
+      2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   3,   0,   0,   4,   5,   0,   0,   0,   0,   0,   0,
+      0,   0,   6,   0,   7,   0,   0,   0,   8,   9,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+static int
+rev_scan(const char* s, int len, int from)
+{
+    int j = from, last = -1;
+
+    (void) len;
+    (void) last;
+    if (from == len) goto s10;
+    goto s0;
+s0:
+    if (j == 0) return last;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s1:
+    if (j == 0) return j;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s2:
+    if (j == 0) return j;
+    last = j;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 8: case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s3:
+    if (j == 0) return last;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 2:
+            goto s4;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s4:
+    if (j == 0) return j;
+    last = j;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 2:
+            goto s4;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s5:
+    if (j == 0) return last;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 7:
+            goto s1;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s6:
+    if (j == 0) return last;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 4:
+            goto s5;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s7:
+    if (j == 0) return last;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 3:
+            goto s6;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s8:
+    if (j == 0) return last;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 5:
+            goto s6;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s9:
+    if (j == 0) return last;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 3:
+            goto s8;
+        case 5:
+            goto s7;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s10:
+    if (j == 0) return last;
+    switch (rev_scan_classes[(unsigned char) s[--j]]) {
+        case 1:
+            goto s3;
+        case 6:
+            goto s9;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+}
+
+static const unsigned char fwd_scan_classes[256] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   0,
+      2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   3,   0,   0,   4,   5,   0,   0,   0,   0,   0,   0,
+      0,   0,   6,   0,   7,   0,   0,   0,   8,   9,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+};
+
+static int
+fwd_scan(const char* s, int len, int from)
+{
+    int j = from, last = -1;
+
+    (void) len;
+    (void) last;
+    if (from == 0) goto s12;
+    goto s6;
+s0:
+    return last;
+s1:
+    if (j == len) return j;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        default:
+            goto s0;
+    }
+s2:
+    if (j == len) return j;
+    last = j;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        default:
+            goto s0;
+    }
+s3:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 1:
+            goto s4;
+        case 2:
+            goto s3;
+        default:
+            goto s0;
+    }
+s4:
+    if (j == len) return j;
+    last = j;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 2:
+            goto s4;
+        default:
+            goto s0;
+    }
+s5:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 8:
+            goto s5;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s6:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 2:
+            goto s3;
+        case 8:
+            goto s5;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+s7:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 6:
+            goto s1;
+        default:
+            goto s0;
+    }
+s8:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 3:
+            goto s7;
+        default:
+            goto s0;
+    }
+s9:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 5:
+            goto s7;
+        default:
+            goto s0;
+    }
+s10:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 3:
+            goto s9;
+        case 5:
+            goto s8;
+        default:
+            goto s0;
+    }
+s11:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 4:
+            goto s10;
+        default:
+            goto s0;
+    }
+s12:
+    if (j == len) return last;
+    switch (fwd_scan_classes[(unsigned char) s[j++]]) {
+        case 2:
+            goto s3;
+        case 7:
+            goto s11;
+        case 8:
+            goto s5;
+        case 9:
+            goto s2;
+        default:
+            goto s0;
+    }
+}
+
+/* The leftmost-longest match in s */
+bool
+RE_GENERATED_NAME(const char* s, int* start, int* end)
+{
+    int len = strlen(s);
+
+    // leftmost start from the end, then longest end from there
+    if ((*start = rev_scan(s, len, len)) < 0) return false;
+    *end = fwd_scan(s, len, *start);
+    return true;
+}
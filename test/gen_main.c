@@ -0,0 +1,28 @@
+/* Driver for the matcher generated from test/gen.re, printing the
+ * matches as ret does */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "gen.c"
+
+enum {
+    BUFSIZE = 81,
+};
+
+int
+main(void)
+{
+    char search[BUFSIZE];
+    char* s;
+    int start, end;
+
+    while (fgets(search,BUFSIZE,stdin)) {
+        if ((s = strrchr(search,'\n'))) *s = '\0';
+        if (gen_match(search, &start, &end))
+            printf("Found: %.*s\n", end - start, search+start);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/* Check re::Regex: the matches of a range, views into the string
+ * searched, anchors part way through, moves and errors */
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../re.hpp"
+
+static int failed = 0;
+
+static void
+check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("failed: %s\n", what);
+        failed++;
+    }
+}
+
+static std::string
+all(re::Regex&& r, std::string_view s)
+{
+    std::string out;
+
+    for (std::string_view m : r.matches(s)) {
+        // a view into s, not a copy
+        check(m.data() >= s.data() && m.data() + m.size() <= s.data() +
+              s.size(), "match is inside the string");
+        out += "<" + std::string(m) + ">";
+    }
+    return out;
+}
+
+int
+main()
+{
+    std::string text = "their thier three";
+
+    check(all(re::Regex("th(ei|ie)r"), text) == "<their><thier>",
+          "successive matches");
+    check(all(re::Regex("^th|e"), text) == "<th><e><e><e><e>",
+          "'^' only at the start");
+    check(all(re::Regex("x*"), "axxb") == "<><xx><><>", "empty matches");
+    check(all(re::Regex("needle"), "needle needle") == "<needle><needle>",
+          "plain string");
+    check(all(re::Regex("he|she|his|hers"), "ushers his") == "<she><his>",
+          "alternate literals");
+    check(all(re::Regex("r$", RE_DFA), "rr r") == "<r>", "'$' at the end");
+
+    // not terminated, and holding a NUL
+    std::string_view part("abcabc", 4);
+    check(all(re::Regex("ab*c*"), part) == "<abc><a>", "string_view length");
+    check(all(re::Regex("a.b"), std::string_view("a\0b", 3)).size() == 5,
+          "NUL matched by '.'");
+
+    re::Regex r("t.*r");
+    re::Regex moved(std::move(r));
+    check(moved.search(text) == "their thier thr", "moved regex");
+    r = re::Regex("e*");
+    check(r.search(text, 2) == "e", "assigned regex, search from");
+
+    bool threw = false;
+    try {
+        re::Regex bad("(ab");
+    }
+    catch (const re::error& e) {
+        threw = std::string_view(e.what()) == "unbalanced parentheses";
+    }
+    check(threw, "error thrown");
+
+    // too long for an int, refused before any of it is read
+    threw = false;
+    try {
+        r.search(std::string_view(text.data(), std::size_t(INT_MAX) + 1));
+    }
+    catch (const re::error& e) {
+        threw = true;
+    }
+    check(threw, "string too long");
+
+    std::printf("%d failures\n", failed);
+    return failed == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
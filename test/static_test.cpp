@@ -0,0 +1,78 @@
+/* Check re::static_regex against re_match, for each pattern over each
+ * line of standard input */
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../re_static.hpp"
+
+// matched at compile time
+static_assert(re::static_regex<"th(ei|ie)r">::search("neither their")->start == 8);
+static_assert(!re::static_regex<"^alpha">::search("an alpha"));
+
+template <re::fixed_string P>
+static int
+check(const std::vector<std::string>& lines)
+{
+    std::string pattern(P.view());
+    struct sm_fsm* fsm = re_compile(pattern.data(), RE_OPT);
+    int failed = 0;
+
+    if (fsm == nullptr) {
+        std::printf("%s: %s\n", pattern.c_str(), re_error_msg());
+        return 1;
+    }
+    for (const std::string& line : lines) {
+        std::string s(line);
+        struct re_matched* matched = re_match(fsm, s.data());
+        auto m = re::static_regex<P>::search(line);
+
+        if (matched == nullptr && !m) continue;
+        if (matched != nullptr && m &&
+            static_cast<std::size_t>(matched->start) == m->start &&
+            static_cast<std::size_t>(matched->end) == m->end) continue;
+        std::printf("%s: \"%s\": re_match %d-%d, static_regex %d-%d\n",
+                    pattern.c_str(), line.c_str(),
+                    matched?matched->start:-1, matched?matched->end:-1,
+                    m?static_cast<int>(m->start):-1,
+                    m?static_cast<int>(m->end):-1);
+        failed++;
+    }
+    return failed;
+}
+
+template <re::fixed_string... Ps>
+static int
+check_all(const std::vector<std::string>& lines)
+{
+    return (check<Ps>(lines) + ...);
+}
+
+int
+main()
+{
+    std::vector<std::string> lines;
+    std::string line;
+
+    while (std::getline(std::cin, line)) lines.push_back(line);
+    lines.push_back("");
+    int failed = check_all<
+        "abc", "a|b|c", "this|that|theother", "((this|that|theother))",
+        "((this)|((that))|(theother))", "abc*", "z(abc)*z",
+        "((a|b)|(c|d)kk*)*z", "th(ei|ie)r", "th(ei|ie)*r", "z(aa*|b(b)*)z",
+        "z(aa*|b(b)*|ccc)*z", "(a*b|ac)d", "^alpha", "alpha$", "^alpha$",
+        "^(alpha|beta)$", "(^alpha|beta$)", "^alpha|^beta$|gamma$", "z.z",
+        "z...z", "z.*z", "z.*(a|b)", "z(a.*|b)z", "z(a.*|bbb|cd.*)z",
+        "z[abc]z", "z[^abc]z", "z[a-y]z", "z[a-y0-9]z", "z[^a-y0-9]z",
+        "z[\\^\\]]z", "z[a-y]*z", "zz[a-y]*", "z(a|[0-9]|b)z",
+        "z(a|[0-9]|b)*z", "a|ab", "(aa*)*b", "xx*$", "[a-c]x[a-c]|[^a-c]",
+        "z[-a-c-]z", "abc*d", ".*ERROR.*timeout", "he|she|his|hers",
+        "(red|green|blue)=", "needle", "^$", "$", "x*", "[^ ]* ",
+        "(^| )EOF$", "\\$RET|RET=">(lines);
+
+    std::printf("%d mismatches\n", failed);
+    return failed == 0?EXIT_SUCCESS:EXIT_FAILURE;
+}
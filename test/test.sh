@@ -1,19 +1,21 @@
 #!/bin/sh
 
+RET=${RET:-./ret}
+
 echo "[Simple sequence of characters: abc]"
-./ret abc <<EOF
+$RET abc <<EOF
 abc
 not
 EOF
 echo "[Simple alternate characters: a|b|c]"
-./ret "a|b|c" <<EOF
+$RET "a|b|c" <<EOF
 a
 b
 c
 x
 EOF
 echo "[Alternate words: this|that|theother]"
-./ret "this|that|theother" <<EOF
+$RET "this|that|theother" <<EOF
 this
 that
 theother
@@ -21,7 +23,7 @@ xx theother xxx
 xx
 EOF
 echo "[Alternate words inside parens: ((this|that|theother))]"
-./ret "((this|that|theother))" <<EOF
+$RET "((this|that|theother))" <<EOF
 this
 that
 theother
@@ -29,7 +31,7 @@ xx theother xxx
 xx
 EOF
 echo "[Alternate words inside parens: ((this)|((that))|(theother))]"
-./ret "((this)|((that))|(theother))" <<EOF
+$RET "((this)|((that))|(theother))" <<EOF
 this
 that
 theother
@@ -37,21 +39,21 @@ xx theother xxx
 xx
 EOF
 echo "[Simple closure- abc*]"
-./ret "abc*" <<EOF
+$RET "abc*" <<EOF
 ab
 abc
 abcccccccccccccccccc
 a
 EOF
 echo "[Expression closure- z(abc)*z]"
-./ret "z(abc)*z" <<EOF
+$RET "z(abc)*z" <<EOF
 zz
 zabcz
 zabcabcabcz
 zabz
 EOF
 echo "[Combination of alternates and closures: ((a|b)|(c|d)kk*)*z]"
-./ret "((a|b)|(c|d)kk*)*z" <<EOF
+$RET "((a|b)|(c|d)kk*)*z" <<EOF
 z
 az
 aaaaz
@@ -63,14 +65,14 @@ ckkkkkkkkkz
 d
 EOF
 echo "[Two character alternates: th(ei|ie)r]"
-./ret "th(ei|ie)r" <<EOF
+$RET "th(ei|ie)r" <<EOF
 their
 thier
 padding their padding
 thr
 EOF
 echo "[With added closure: th(ei|ie)*r]"
-./ret "th(ei|ie)*r" <<EOF
+$RET "th(ei|ie)*r" <<EOF
 their
 theieieieir
 thieeiieeir
@@ -78,7 +80,7 @@ thr
 xxx
 EOF
 echo "[More alternate closures: z(aa*|b(b)*)z]"
-./ret "z(aa*|b(b)*)z" <<EOF
+$RET "z(aa*|b(b)*)z" <<EOF
 zaz
 zaaaaaaaaaaaz
 zbz
@@ -86,7 +88,7 @@ zbbbbbbbbbbbz
 zz
 EOF
 echo "[More alternate closures: z(aa*|b(b)*|ccc)*z]"
-./ret "z(aa*|b(b)*|ccc)*z" <<EOF
+$RET "z(aa*|b(b)*|ccc)*z" <<EOF
 zaz
 zaaaaaaaaaaaz
 zbz
@@ -96,7 +98,7 @@ zcccz
 kz
 EOF
 echo "[Alternates with closure and shared starting chars: (a*b|ac)d]"
-./ret "(a*b|ac)d" <<EOF
+$RET "(a*b|ac)d" <<EOF
 abd
 acd
 aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaabd
@@ -105,31 +107,31 @@ EOF
 # Testing anchors
 
 echo "[Anchors: ^alpha"]
-./ret "^alpha" <<EOF
+$RET "^alpha" <<EOF
 alpha
 alpha alpha
 not alpha
 EOF
 echo "[Anchors: alpha$]"
-./ret "alpha$" <<EOF
+$RET "alpha$" <<EOF
 xxx alpha
 alpha alpha
 alpha not
 EOF
 echo "[Anchors: ^alpha$]"
-./ret "^alpha$" <<EOF
+$RET "^alpha$" <<EOF
 alpha
 not alpha
 alpha not
 EOF
 echo "[Anchors: ^(alpha|beta)$]"
-./ret "^(alpha|beta)$" <<EOF
+$RET "^(alpha|beta)$" <<EOF
 alpha
 beta
 alphabeta
 EOF
 echo "[Anchors: (^alpha|beta$)]"
-./ret "(^alpha|beta$)" <<EOF
+$RET "(^alpha|beta$)" <<EOF
 alpha trailing
 preceeding beta
 alpha
@@ -137,7 +139,7 @@ beta
  alpha
 EOF
 echo "[Anchors: ^alpha|^beta$|gamma$]"
-./ret "^alpha|^beta$|gamma$" <<EOF
+$RET "^alpha|^beta$|gamma$" <<EOF
 alpha
 alpha xxx
 beta
@@ -152,47 +154,47 @@ EOF
 # Testing dot (wildcard)
 
 echo "[Single dot: z.z]"
-./ret "z.z" <<EOF
+$RET "z.z" <<EOF
 zaz
 zbz
 zz
 EOF
 echo "[Three dots: z...z]"
-./ret "z...z" <<EOF
+$RET "z...z" <<EOF
 zaaaz
 zbbgz
 zz
 EOF
 echo "[Dot closure: z.*z]"
-./ret "z.*z" <<EOF
+$RET "z.*z" <<EOF
 zaaaz
 zlots of characters that aren't z
 zz
  z
 EOF
 echo "[Dot closure followed by alternate: z.*(a|b)]"
-./ret "z.*(a|b)" <<EOF
+$RET "z.*(a|b)" <<EOF
 zkkkkkka
 zjkjkjkjueyb
 zzzzzzzzzzzzzzzzza
 zz
 EOF
 echo "[Dot closure as alternate: z(a.*|b)z]"
-./ret "z(a.*|b)z" <<EOF
+$RET "z(a.*|b)z" <<EOF
 zakkkkkkz
 zbz
 zzaaaaaaaaz
 zz
 EOF
 echo "[Dot closure as alternates: z(a.*|bbb|cd.*)z]"
-./ret "z(a.*|bbb|cd.*)z" <<EOF
+$RET "z(a.*|bbb|cd.*)z" <<EOF
 zakksdjksjz
 zbbbz
 zcdsomthing not z
 zz
 EOF
 echo "[Character class: z[abc]z]"
-./ret "z[abc]z" <<EOF
+$RET "z[abc]z" <<EOF
 zaz
 zbz
 zcz
@@ -200,7 +202,7 @@ zdz
 zz
 EOF
 echo "[Character class negation: z[^abc]z]"
-./ret "z[^abc]z" <<EOF
+$RET "z[^abc]z" <<EOF
 zdz
 zez
 zfz
@@ -210,7 +212,7 @@ zbz
 zz
 EOF
 echo "[Character class range: z[a-y]z]"
-./ret "z[a-y]z" <<EOF
+$RET "z[a-y]z" <<EOF
 zaz
 zbz
 zcz
@@ -221,7 +223,7 @@ z1z
 zz
 EOF
 echo "[Character class ranges: z[a-y0-9]z]"
-./ret "z[a-y0-9]z" <<EOF
+$RET "z[a-y0-9]z" <<EOF
 zaz
 zbz
 zcz
@@ -236,7 +238,7 @@ z]]]z
 zz
 EOF
 echo "[Character class negation ranges: z[^a-y0-9]z]"
-./ret "z[^a-y0-9]z" <<EOF
+$RET "z[^a-y0-9]z" <<EOF
 zzz
 zAz
 zZz
@@ -254,7 +256,7 @@ z]]]z
 zz
 EOF
 echo "[Character class meta as regular: z[\^\]]z]"
-./ret 'z[\^\]]z' <<EOF
+$RET 'z[\^\]]z' <<EOF
 zzz
 zaz
 zbz
@@ -262,7 +264,7 @@ z]z
 z^z
 EOF
 echo "[Character class range with closure: z[a-y]*z]"
-./ret "z[a-y]*z" <<EOF
+$RET "z[a-y]*z" <<EOF
 zaz
 zbz
 zcz
@@ -275,14 +277,14 @@ z1z
 z]z
 EOF
 echo "[Character class range with closure at end: zz[a-y]*]"
-./ret "zz[a-y]*" <<EOF
+$RET "zz[a-y]*" <<EOF
 zza
 zzaaaaaaaaaaaaaaaa
 zzabcdefghijuk
 xx
 EOF
 echo "[Character class range with alternates: z(a|[0-9]|b)z]"
-./ret "z(a|[0-9]|b)z" <<EOF
+$RET "z(a|[0-9]|b)z" <<EOF
 zaz
 zbz
 z0z
@@ -292,7 +294,7 @@ zzz
 xx
 EOF
 echo "[Character class range with alternates & closure: z(a|[0-9]|b)*z]"
-./ret "z(a|[0-9]|b)*z" <<EOF
+$RET "z(a|[0-9]|b)*z" <<EOF
 zaz
 zbz
 z0ab9z
@@ -301,3 +303,125 @@ z7aaaaaaaaaaaaaaaz
 zzz
 xx
 EOF
+
+# Testing match position
+
+echo "[Leftmost longest alternate: a|ab]"
+$RET "a|ab" <<EOF
+ab
+aab
+b
+EOF
+echo "[Nested closures: (aa*)*b]"
+$RET "(aa*)*b" <<EOF
+aab
+aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab
+xxxxb
+aaaa
+EOF
+echo "[Closure at end: xx*$]"
+$RET "xx*$" <<EOF
+axxx
+xxxa
+yx
+EOF
+echo "[Shared character classes: [a-c]x[a-c]|[^a-c]]"
+$RET "[a-c]x[a-c]|[^a-c]" <<EOF
+axb
+cxx
+bx
+EOF
+echo "[Character class leading and trailing dash: z[-a-c-]z]"
+$RET "z[-a-c-]z" <<EOF
+z-z
+zbz
+zdz
+EOF
+echo "[Literal prefix: abc*d]"
+$RET "abc*d" <<EOF
+xxababxabcccd
+abab
+xxabd
+EOF
+echo "[Required literal: .*ERROR.*timeout]"
+$RET ".*ERROR.*timeout" <<EOF
+ok, no errors
+ERROR: read timeout
+timeout before ERROR
+EOF
+echo "[Overlapping literal alternates: he|she|his|hers]"
+$RET "he|she|his|hers" <<EOF
+ushers
+ahishe
+sh
+EOF
+echo "[Prefix set: (red|green|blue)=]"
+$RET "(red|green|blue)=" <<EOF
+the colour of the sky is blue, the grass is green=yes
+red
+blue= and red=
+EOF
+echo "[Plain string: needle]"
+$RET "needle" <<EOF
+a long line with the word needl broken, then a needle in a haystack
+needle
+needles and needle
+EOF
+echo "[Closures after a dot closure: .*b*c*]"
+$RET ".*b*c*" <<EOF
+axbaccb
+^.*a*
+EOF
+echo "[Factored alternates: x(this|that|thee|ab|cb|a|b)y]"
+$RET "x(this|that|thee|ab|cb|a|b)y" <<EOF
+xthaty
+xtheey
+xcby
+xby
+xty
+EOF
+echo "[Nested closures: (aa*)*b|(a*|c)*d]"
+$RET "(aa*)*b|(a*|c)*d" <<EOF
+xaaab
+xcacd
+xd
+EOF
+echo "[End anchor alone: $]"
+$RET '$' <<EOF
+abc
+EOF
+echo "[Literals held past a step, taken in order of start: (ab|b|bbaba|baba)]"
+$RET "(ab|b|bbaba|baba)" <<EOF
+aabaaaabbaaaaba
+ababbabbbabbaabbbbaabaabbababab
+EOF
+echo "[Literals of different lengths held together: (bbab|aaaa|ab)]"
+$RET "(bbab|aaaa|ab)" <<EOF
+bbbababbbabbabbabbbaaabbab
+EOF
+echo "[Long pattern: ab 50000 times, then .]"
+$RET "$(awk 'BEGIN { for (i = 0; i < 50000; i++) printf "ab"; print "." }')" \
+    <<EOF || echo "failed"
+abab
+EOF
+echo "[Long pattern, matching: x, a* 50000 times, then b]"
+$RET "x$(awk 'BEGIN { for (i = 0; i < 50000; i++) printf "a*" }')b" \
+    <<EOF || echo "failed"
+xaaab
+xb
+xab xaab
+x
+EOF
+echo "[Many alternates, each rewritten once: (w1|...|w10000|w1|...|w10000)z]"
+words=$(awk 'BEGIN {
+    for (i = 1; i <= 10000; i++) printf "%sw%d", (i > 1)?"|":"", i
+}')
+# compared two by two, they took seconds
+limit=
+if command -v timeout >/dev/null; then limit="timeout 2"; fi
+$limit $RET "($words|$words)z" <<EOF || echo "failed"
+w17z
+w10001z
+xw9999zx
+w0z
+EOF